@@ -0,0 +1,163 @@
+// CollisionLog.cpp: Collision events recorded per thread and written out by a background thread
+
+#include "CollisionLog.h"
+#include "Simulation.h"
+#include <iostream>
+#include <algorithm>
+
+CollisionLog collisionLog;
+
+//Writes out the events waiting in a ring, or formats them onto text, returns how many there were
+static uint32_t DrainCollisionEvents(CollisionEventRing& ring, std::string& text)
+{
+    uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint32_t head = ring.head.load(std::memory_order_acquire);
+    uint32_t count = head - tail;
+
+    if (collisionLog.format == CollisionLogFormat::Binary)
+    {
+        // The waiting events are at most two contiguous runs of the ring
+        uint32_t first = tail & (COLLISION_RING_SIZE - 1);
+        uint32_t firstCount = std::min(count, COLLISION_RING_SIZE - first);
+        std::fwrite(ring.events.data() + first, sizeof(CollisionEvent), firstCount, collisionLog.file);
+        std::fwrite(ring.events.data(), sizeof(CollisionEvent), count - firstCount, collisionLog.file);
+    }
+    else
+    {
+        for (uint32_t i = tail; i != head; ++i)
+        {
+            const CollisionEvent& event = ring.events[i & (COLLISION_RING_SIZE - 1)];
+            const CircleName& otherName = event.kind == CollisionKind::Stationary ? collisionLog.stationaryNames[event.other] : collisionLog.movingNames[event.other];
+
+            text += "Collision at ";
+            text += std::to_string(event.time);
+            text += " microseconds: ";
+            text.append(collisionLog.movingNames[event.moving].text, NAME_LENGTH);
+            text += " - ";
+            text += std::to_string(event.movingHp);
+            text += " ";
+            text.append(otherName.text, NAME_LENGTH);
+            text += " - ";
+            text += std::to_string(event.otherHp);
+            text += '\n';
+        }
+    }
+
+    ring.tail.store(head, std::memory_order_release);
+    return count;
+}
+
+//Log thread, polls the rings until stopped then drains whatever is left
+static void CollisionLogThread()
+{
+    std::string text;
+    while (true)
+    {
+        bool stopping = collisionLog.stopping.load();
+
+        // Names are only read while formatting, so the lock is let go before the console or disk is written to, which
+        // could hold up a step adding names for a long time
+        uint32_t drained = 0;
+        {
+            std::unique_lock<std::mutex> namesGuard(collisionLog.namesLock, std::defer_lock);
+            if (collisionLog.format == CollisionLogFormat::Text)
+            {
+                namesGuard.lock();
+            }
+            for (uint32_t i = 0; i < collisionLog.numRings; ++i)
+            {
+                drained += DrainCollisionEvents(collisionLog.rings[i], text);
+            }
+        }
+        if (!text.empty())
+        {
+            std::cout.write(text.data(), text.size());
+            text.clear();
+        }
+
+        if (stopping)
+        {
+            break;
+        }
+        if (drained == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+void StartCollisionLog(CollisionLogFormat format, const char* path, uint32_t numThreads, const World& world)
+{
+    if (format == CollisionLogFormat::None)
+    {
+        return;
+    }
+
+    collisionLog.format = format;
+    if (format == CollisionLogFormat::Binary)
+    {
+        collisionLog.file = std::fopen(path, "wb");
+        if (!collisionLog.file)
+        {
+            std::cout << "Could not open " << path << ", collision log disabled" << std::endl;
+            return;
+        }
+        CollisionLogHeader header = { { 'D', 'O', 'D', 'C', 'O', 'L', 'L', '\0' }, 1, sizeof(CollisionEvent) };
+        std::fwrite(&header, sizeof(header), 1, collisionLog.file);
+    }
+
+    // The world's pools are already indexed by id, so they copy across whole
+    collisionLog.movingNames.assign(world.movingNames.begin(), world.movingNames.end());
+    collisionLog.stationaryNames.assign(world.stationaryNames.begin(), world.stationaryNames.end());
+
+    collisionLog.numRings = numThreads;
+    for (uint32_t i = 0; i < numThreads; ++i)
+    {
+        collisionLog.rings[i].events.resize(COLLISION_RING_SIZE);
+    }
+
+    collisionLog.enabled = true;
+    collisionLog.stopping = false;
+    collisionLog.start = std::chrono::steady_clock::now();
+    collisionLog.thread = std::thread(&CollisionLogThread);
+}
+
+void AddCollisionLogStationaryName(uint32_t id, const CircleName& name)
+{
+    if (!collisionLog.enabled)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> namesGuard(collisionLog.namesLock);
+    if (collisionLog.stationaryNames.size() <= id)
+    {
+        collisionLog.stationaryNames.resize(id + 1);
+    }
+    collisionLog.stationaryNames[id] = name;
+}
+
+uint64_t StopCollisionLog()
+{
+    if (!collisionLog.enabled)
+    {
+        return 0;
+    }
+
+    collisionLog.stopping = true;
+    collisionLog.thread.join();
+    if (collisionLog.file)
+    {
+        std::fclose(collisionLog.file);
+        collisionLog.file = nullptr;
+    }
+    collisionLog.enabled = false;
+
+    uint64_t dropped = 0;
+    for (uint32_t i = 0; i < collisionLog.numRings; ++i)
+    {
+        dropped += collisionLog.rings[i].dropped;
+    }
+    return dropped;
+}
+
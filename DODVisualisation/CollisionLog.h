@@ -0,0 +1,134 @@
+// CollisionLog.h: Collision events recorded per thread and written out by a background thread
+#pragma once
+
+#include "JobScheduler.h"
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <string>
+
+struct World;
+
+//---------------------------------------------------------------------------------------------------------------------
+// Names
+//---------------------------------------------------------------------------------------------------------------------
+
+const uint32_t NAME_LENGTH = 10;
+
+//A circle's name, exactly NAME_LENGTH letters with no terminator. Names are kept in pools indexed by circle id and only
+//read when an event is formatted as text
+struct CircleName
+{
+    char text[NAME_LENGTH];
+};
+
+//Where collision events go
+enum class CollisionLogFormat
+{
+    None,
+    Text,  //Formatted lines on the console
+    Binary //Raw CollisionEvent records in a file
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Collision Log
+//---------------------------------------------------------------------------------------------------------------------
+
+// Collisions are recorded as fixed size events into a preallocated ring per thread, so the simulation never allocates or
+// waits on I/O. A background thread drains the rings and formats them as text or writes them raw to a binary log.
+// A ring that is full drops the event and counts it rather than making the simulation wait
+
+enum class CollisionKind : uint32_t
+{
+    Stationary, //other is the id of the stationary circle
+    Moving      //other is the id of another moving circle
+};
+
+struct CollisionEvent
+{
+    int64_t time;       //Microseconds since start
+    CollisionKind kind;
+    uint32_t moving;    //Id of the moving circle
+    uint32_t other;
+    int32_t movingHp;   //hp after the collision
+    int32_t otherHp;
+    uint32_t padding;
+};
+static_assert(sizeof(CollisionEvent) == 32, "CollisionEvent is written raw to the binary log");
+
+const uint32_t COLLISION_RING_SIZE = 1 << 14; //Events per thread, must be a power of two
+
+// Single producer (the simulation thread owning it), single consumer (the log thread). Head and tail are on their own
+// cache lines so the two threads don't contend
+struct CollisionEventRing
+{
+    std::vector<CollisionEvent> events;
+    alignas(64) std::atomic<uint32_t> head{ 0 };
+    alignas(64) std::atomic<uint32_t> tail{ 0 };
+    alignas(64) uint64_t dropped = 0;
+};
+
+// Header of the binary log, followed by CollisionEvent records until end of file
+struct CollisionLogHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t eventSize;
+};
+
+struct CollisionLog
+{
+    CollisionEventRing rings[MAX_THREADS];
+    uint32_t numRings = 0;
+    bool enabled = false;
+    CollisionLogFormat format;
+    std::FILE* file = nullptr;
+    std::thread thread;
+    std::atomic<bool> stopping{ false };
+    std::chrono::steady_clock::time_point start; //Event times are measured from here
+
+    // Name pools copied at startup and read by the log thread. Stationary circles inserted later add theirs under
+    // namesLock, which the log thread holds while it formats text but not while it writes it
+    std::mutex namesLock;
+    std::vector<CircleName> movingNames;
+    std::vector<CircleName> stationaryNames;
+};
+
+extern CollisionLog collisionLog;
+
+//Records a collision in the calling thread's ring, never blocks
+inline void PushCollisionEvent(CollisionEventRing& ring, CollisionKind kind, uint32_t moving, uint32_t other, int32_t movingHp, int32_t otherHp)
+{
+    uint32_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= COLLISION_RING_SIZE)
+    {
+        ++ring.dropped;
+        return;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - collisionLog.start);
+
+    CollisionEvent& event = ring.events[head & (COLLISION_RING_SIZE - 1)];
+    event.time = elapsed.count();
+    event.kind = kind;
+    event.moving = moving;
+    event.other = other;
+    event.movingHp = movingHp;
+    event.otherHp = otherHp;
+    event.padding = 0;
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+//Copies the world's names and starts the log thread, with a ring for each of numThreads simulation threads. path is the
+//file written in Binary format. Event times are measured from this call
+void StartCollisionLog(CollisionLogFormat format, const char* path, uint32_t numThreads, const World& world);
+
+//Names a stationary circle inserted after the log started, call before it can collide
+void AddCollisionLogStationaryName(uint32_t id, const CircleName& name);
+
+//Stops the log thread once every recorded event is written, returns the number of events dropped because a ring was full
+uint64_t StopCollisionLog();
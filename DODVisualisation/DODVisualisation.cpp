@@ -2,708 +2,125 @@
 
 #include <Windows.h>
 #include <TL-Engine.h>	// TL-Engine include file and namespace
+#include "Profile.h"
+#include "RenderSink.h"
+#include "Snapshot.h"
+#include "Trajectory.h"
 #include <iostream>
+#include <fstream>
 #include <ctime>
 #include <chrono>
 #include <thread>
-#include <condition_variable>
 #include <vector>
 #include <algorithm>
-#include <string>
+#include <cmath>
 using namespace tle;
 
-//---------------------------------------------------------------------------------------------------------------------
-// Constants
-//---------------------------------------------------------------------------------------------------------------------
-const int CIRCLE_NUM = 25000;
-const int MOVING_NUM = CIRCLE_NUM / 2;
-const int STATIONARY_NUM = CIRCLE_NUM - MOVING_NUM;
-
-const int MAX_X = 1000;
-const int MAX_Y = 1000;
-const int MIN_X = -1000;
-const int MIN_Y = -1000;
-
-const int WALL_MAX_X = MAX_X + MAX_X / 10;
-const int WALL_MAX_Y = MAX_Y + MAX_Y / 10;
-const int WALL_MIN_X = MIN_X + MIN_X / 10;
-const int WALL_MIN_Y = MIN_Y + MIN_Y / 10;
-
-const int MAXVEL_X = 50;
-const int MAXVEL_Y = 50;
-const int MINVEL_X = -50;
-const int MINVEL_Y = -50;
-
-const int MAX_RAD = 5;
-const int MIN_RAD = 1;
-
-//Options
-const bool VISUALIZER = true;
-const bool DEATH = false;
-const bool WALLS = true;
-const bool RANDRADIUS = true;
-
-//---------------------------------------------------------------------------------------------------------------------
-// Circle Data
-//---------------------------------------------------------------------------------------------------------------------
-
-struct Circle
-{
-    float rad;
-    float x;
-    float y;
-
-    Circle()
-    {
-        if (RANDRADIUS)
-        {
-            rad = MIN_RAD + (std::rand() % (MAX_RAD - MIN_RAD + 1));
-        }
-        else
-        {
-            rad = 1;
-        }
-        
-        x = MIN_X + (std::rand() % (MAX_X - MIN_X + 1));
-        y = MIN_Y + (std::rand() % (MAX_Y - MIN_Y + 1));
-
-    };
-};
-
-struct CircleVelocity
-{
-    float x;
-    float y;
-
-    CircleVelocity()
-    {
-        x = MINVEL_X + (std::rand() % (MAXVEL_X - MINVEL_X + 1));
-        y = MINVEL_Y + (std::rand() % (MAXVEL_Y - MINVEL_Y + 1));
-    };
-
-};
-
-struct CircleCollisionData
-{
-    std::string name;
-    int hp;
-
-    CircleCollisionData() 
-    {
-        name = 'a' + rand() % 26;
-        name.push_back('a' + rand() % 26); name.push_back('a' + rand() % 26); name.push_back('a' + rand() % 26); name.push_back('a' + rand() % 26); name.push_back('a' + rand() % 26); name.push_back('a' + rand() % 26); name.push_back('a' + rand() % 26); name.push_back('a' + rand() % 26); name.push_back('a' + rand() % 26);
-        hp = 100;
-    };
-};
-
-struct CircleColourData
-{
-    float r;
-    float g;
-    float b;
-
-    CircleColourData()
-    {
-        r = (std::rand() % 255) / 255.0f;
-        g = (std::rand() % 255) / 255.0f;
-        b = (std::rand() % 255) / 255.0f;
-    };
-};
-
-bool CircleSorter(Circle const& lhs, Circle const& rhs)
-{
-    return lhs.x < rhs.x;
-}
-
-Circle movingCircles[MOVING_NUM];
-CircleVelocity movingVelocitys[MOVING_NUM];
-CircleCollisionData movingCollisions[MOVING_NUM];
-CircleColourData movingColours[MOVING_NUM];
-
-Circle stationaryCircles[STATIONARY_NUM];
-CircleCollisionData stationaryCollisions[STATIONARY_NUM];
-CircleColourData stationaryColours[STATIONARY_NUM];
-
-auto start = std::chrono::steady_clock::now();
-
-//---------------------------------------------------------------------------------------------------------------------
-// Thread Pools
-//---------------------------------------------------------------------------------------------------------------------
-
-// A worker thread wakes up when work is signalled to be ready, and signals back when the work is complete.
-// Same condition variable is used for signalling in both directions.
-// A mutex is used to guard data shared between threads
-struct WorkerThread
-{
-    std::thread             thread;
-    std::condition_variable workReady;
-    std::mutex              lock;
-};
-
-// Data describing work to do by a worker thread - this task is collision detection between some sprites against some blockers
-struct CollisionWork
-{
-    bool complete = true;
-    float frametime;
-    uint32_t numMoving;
-    Circle* moving;
-    CircleVelocity* movingVel;
-    CircleCollisionData* movingCollision;
-    uint32_t numStationary;
-    Circle* stationary;
-    CircleCollisionData* stationaryCollision;
-    std::vector<std::string> output;
-};
-
-struct ModelWork
-{
-    bool complete = true;
-    uint32_t numMoving;
-    Circle* moving;
-    CircleVelocity* movingVel;
-    CircleCollisionData* movingCollision;
-    IModel** movingModel;
-    uint32_t numStationary;
-    Circle* stationary;
-    CircleCollisionData* stationaryCollision;
-    IModel** stationaryModel;
-
-};
-
-static const uint32_t MAX_WORKERS = 31;
-std::pair<WorkerThread, CollisionWork> collisionWorkers[MAX_WORKERS];
-std::pair<WorkerThread, ModelWork> modelWorkers[MAX_WORKERS];
-uint32_t mNumWorkers;  // Actual number of worker threads being used in array above
-
-//Vector for collision message output
-std::vector<std::string> collisionsOutput[MAX_WORKERS];
+//Snapshot F5 writes, load it back with "snapshot = DODVisualisation.snap" in the config file
+const char* const CHECKPOINT_FILE = "DODVisualisation.snap";
 
 //---------------------------------------------------------------------------------------------------------------------
 // Functions
 //---------------------------------------------------------------------------------------------------------------------
 
-//Multithreaded method for checking if circles collide with circles with text output
-void CheckCircleCollision(float frametime, uint32_t numMoving, Circle* moving, CircleVelocity* movingVel, CircleCollisionData* movingCollision, uint32_t numStationary, Circle* stationary, CircleCollisionData* stationaryCollision, std::vector<std::string>& collisions)
+//Render sink moving the TL-Engine models of the changed circles, one call each. Models are indexed by circle id as the
+//moving arrays get re-sorted, context is the array of them
+static void MoveModels(void* context, uint32_t numMoving, const Circle* moving, const uint32_t* movingId, const uint64_t* changed)
 {
-    auto movingEnd = moving + numMoving;
-    auto stationaryEnd = stationary + numStationary;
-    auto stationaryCollisionEnd = stationaryCollision + numStationary;
-
-    while (moving != movingEnd)
+    IModel** movingModel = static_cast<IModel**>(context);
+    ForEachChanged(numMoving, changed, [&](uint32_t i)
     {
-        float mvelx = movingVel->x;
-        float mvely = movingVel->y;
-
-        moving->x += mvelx * frametime;
-        moving->y += mvely * frametime;
-
-        float mx = moving->x;
-        float my = moving->y;
-
-        float mrad = moving->rad;
-
-        float mradx = moving->x - mrad;
-        float mxrad = moving->x + mrad;
-
-        //Binary search
-        auto s = stationary;
-        auto e = stationaryEnd;
-        auto sC = stationaryCollision;
-        auto eC = stationaryCollisionEnd;
-        Circle* mid;
-        CircleCollisionData* midC;
-        bool found = false;
-        do
-        {
-            mid = s + (e - s) / 2;
-            midC = sC + (eC - sC) / 2;
-
-            float midradx = mid->x - mid->rad;
-            float midxrad = mid->x + mid->rad;
-
-            if (mxrad <= midradx)
-            {
-                e = mid;
-                eC = midC;
-            }
-            else if (mradx >= midxrad)
-            {
-                s = mid;
-                sC = midC;
-            }
-            else found = true;
-        } while (!found && e - s > 1);
-
-        // If no overlapping x-range found then no collision
-        if (found)
-        {
-            bool collided = false;
-
-            // Search from the stationary found in the strip, in a rightwards direction, until outside strip or end of list
-            auto currentstationary = mid;
-            auto currentstationaryCollision = midC;
-            while (mxrad > currentstationary->x - currentstationary->rad && currentstationary != stationaryEnd)
-            {
-                float sx = currentstationary->x;
-                float sy = currentstationary->y;
-
-                float srad = currentstationary->rad;
-
-                float mx_sx = sx - mx;
-                float my_sy = sy - my;
-
-                float dist = sqrt((mx_sx * mx_sx) + (my_sy * my_sy));
-
-                if (dist < mrad + srad)
-                {
-                    //Move the circle so it is no longer colliding
-                    float moveddist;
-                    do
-                    {
-                        moving->x -= mvelx * 1.1f * frametime;
-                        moving->y -= mvely * 1.1f * frametime;
-
-                        float movedmx_sx = sx - moving->x;
-                        float movedmy_sy = sy - moving->y;
-
-                        moveddist = sqrt((movedmx_sx * movedmx_sx) + (movedmy_sy * movedmy_sy));
-                    } while (moveddist < mrad + srad);
-
-                    //Refeclt velocity of the moving circle
-                    float normx = sx - mx;
-                    float normy = sy - my;
-                    float mag = sqrt((normx * normx) + (normy * normy));
-                    normx /= mag;
-                    normy /= mag;
-                    float dot = (mvelx * normx) + (mvely * normy);
-
-                    movingVel->x = mvelx - normx * (dot * 2.0f);
-                    movingVel->y = mvely - normy * (dot * 2.0f);
-
-                    movingCollision->hp -= 20;
-                    currentstationaryCollision->hp -= 20;
-
-                    auto end = std::chrono::steady_clock::now();
-                    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-
-                    collisions.push_back("Collision at " + std::to_string(elapsed.count()) + " microseconds: " + movingCollision->name + " - " + std::to_string(movingCollision->hp) + " " + currentstationaryCollision->name + " - " + std::to_string(currentstationaryCollision->hp));
-
-                    collided = true;
-                    break;
-                }
-                ++currentstationary;
-                ++currentstationaryCollision;
-            }
-
-            // Search from the stationary found in the strip, in a lefttwards direction, until outside strip or end of list
-            if (!collided)
-            {
-                currentstationary = mid;
-                currentstationaryCollision = midC;
-                while (currentstationary-- != stationary && currentstationaryCollision-- != stationaryCollision && mradx < currentstationary->x + currentstationary->rad)
-                {
-                    float sx = currentstationary->x;
-                    float sy = currentstationary->y;
-
-                    float srad = currentstationary->rad;
-
-                    float mx_sx = sx - mx;
-                    float my_sy = sy - my;
-
-                    float dist = sqrt((mx_sx * mx_sx) + (my_sy * my_sy));
-
-                    if (dist < mrad + srad)
-                    {
-                        //Move the circle so it is no longer colliding
-                        float moveddist;
-                        do
-                        {
-                            moving->x -= mvelx * 1.1f * frametime;
-                            moving->y -= mvely * 1.1f * frametime;
-
-                            float movedmx_sx = sx - moving->x;
-                            float movedmy_sy = sy - moving->y;
-
-                            moveddist = sqrt((movedmx_sx * movedmx_sx) + (movedmy_sy * movedmy_sy));
-                        } while (moveddist < mrad + srad);
-
-                        //Refeclt velocity of the moving circle
-                        float normx = sx - mx;
-                        float normy = sy - my;
-                        float mag = sqrt((normx * normx) + (normy * normy));
-                        normx /= mag;
-                        normy /= mag;
-                        float dot = (mvelx * normx) + (mvely * normy);
-
-                        movingVel->x = mvelx - normx * (dot * 2.0f);
-                        movingVel->y = mvely - normy * (dot * 2.0f);
-
-                        movingCollision->hp -= 20;
-                        currentstationaryCollision->hp -= 20;
-
-                        auto end = std::chrono::steady_clock::now();
-                        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-
-                        collisions.push_back("Collision at " + std::to_string(elapsed.count()) + " microseconds: " + movingCollision->name + " - " + std::to_string(movingCollision->hp) + " " + currentstationaryCollision->name + " - " + std::to_string(currentstationaryCollision->hp));
-
-                        break;
-                    }
-                }
-            }
-        }
-        ++moving;
-        ++movingVel;
-        ++movingCollision;
-    }
+        movingModel[movingId[i]]->SetPosition(moving[i].x, moving[i].y, 0.0f);
+    });
 }
 
-//Multithreaded method for checking if circles collide with circles
-void CheckCircleCollision(float frametime, uint32_t numMoving, Circle* moving, CircleVelocity* movingVel, CircleCollisionData* movingCollision, uint32_t numStationary, Circle* stationary, CircleCollisionData* stationaryCollision)
+static IModel* CreateMovingModel(IMesh* ballMesh, const Circle& circle)
 {
-    auto movingEnd = moving + numMoving;
-    auto stationaryEnd = stationary + numStationary;
-    auto stationaryCollisionEnd = stationaryCollision + numStationary;
-
-    while (moving != movingEnd)
-    {
-        float mvelx = movingVel->x;
-        float mvely = movingVel->y;
-
-        moving->x += mvelx * frametime;
-        moving->y += mvely * frametime;
-
-        float mx = moving->x;
-        float my = moving->y;
-
-        float mrad = moving->rad;
-
-        float mradx = moving->x - mrad;
-        float mxrad = moving->x + mrad;
-
-        //Binary search
-        auto s = stationary;
-        auto e = stationaryEnd;
-        auto sC = stationaryCollision;
-        auto eC = stationaryCollisionEnd;
-        Circle* mid;
-        CircleCollisionData* midC;
-        bool found = false;
-        do
-        {
-            mid = s + (e - s) / 2;
-            midC = sC + (eC - sC) / 2;
-
-            float midradx = mid->x - mid->rad;
-            float midxrad = mid->x + mid->rad;
-
-            if (mxrad <= midradx)
-            {
-                e = mid;
-                eC = midC;
-            }
-            else if (mradx >= midxrad)
-            {
-                s = mid;
-                sC = midC;
-            }
-            else found = true;
-        } while (!found && e - s > 1);
-
-        // If no overlapping x-range found then no collision
-        if (found)
-        {
-            bool collided = false;
-
-            // Search from the stationary found in the strip, in a rightwards direction, until outside strip or end of list
-            auto currentstationary = mid;
-            auto currentstationaryCollision = midC;
-            while (mxrad > currentstationary->x - currentstationary->rad && currentstationary != stationaryEnd)
-            {
-                float sx = currentstationary->x;
-                float sy = currentstationary->y;
-
-                float srad = currentstationary->rad;
-
-                float mx_sx = sx - mx;
-                float my_sy = sy - my;
-
-                float dist = sqrt((mx_sx * mx_sx) + (my_sy * my_sy));
-
-                if (dist < mrad + srad)
-                {
-                    //Move the circle so it is no longer colliding
-                    float moveddist;
-                    do
-                    {
-                        moving->x -= mvelx * 1.1f * frametime;
-                        moving->y -= mvely * 1.1f * frametime;
-
-                        float movedmx_sx = sx - moving->x;
-                        float movedmy_sy = sy - moving->y;
-
-                        moveddist = sqrt((movedmx_sx * movedmx_sx) + (movedmy_sy * movedmy_sy));
-                    } while (moveddist < mrad + srad);
-
-                    //Refeclt velocity of the moving circle
-                    float normx = sx - mx;
-                    float normy = sy - my;
-                    float mag = sqrt((normx * normx) + (normy * normy));
-                    normx /= mag;
-                    normy /= mag;
-                    float dot = (mvelx * normx) + (mvely * normy);
-
-                    movingVel->x = mvelx - normx * (dot * 2.0f);
-                    movingVel->y = mvely - normy * (dot * 2.0f);
-
-                    movingCollision->hp -= 20;
-                    currentstationaryCollision->hp -= 20;
-                    collided = true;
-                    break;
-                }
-                ++currentstationary;
-                ++currentstationaryCollision;
-            }
-
-            // Search from the stationary found in the strip, in a lefttwards direction, until outside strip or end of list
-            if (!collided)
-            {
-                currentstationary = mid;
-                currentstationaryCollision = midC;
-                while (currentstationary-- != stationary && currentstationaryCollision-- != stationaryCollision && mradx < currentstationary->x + currentstationary->rad)
-                {
-                    float sx = currentstationary->x;
-                    float sy = currentstationary->y;
-
-                    float srad = currentstationary->rad;
-
-                    float mx_sx = sx - mx;
-                    float my_sy = sy - my;
-
-                    float dist = sqrt((mx_sx * mx_sx) + (my_sy * my_sy));
-
-                    if (dist < mrad + srad)
-                    {
-                        //Move the circle so it is no longer colliding
-                        float moveddist;
-                        do
-                        {
-                            moving->x -= mvelx * 1.1f * frametime;
-                            moving->y -= mvely * 1.1f * frametime;
-
-                            float movedmx_sx = sx - moving->x;
-                            float movedmy_sy = sy - moving->y;
-
-                            moveddist = sqrt((movedmx_sx * movedmx_sx) + (movedmy_sy * movedmy_sy));
-                        } while (moveddist < mrad + srad);
-
-                        //Refeclt velocity of the moving circle
-                        float normx = sx - mx;
-                        float normy = sy - my;
-                        float mag = sqrt((normx * normx) + (normy * normy));
-                        normx /= mag;
-                        normy /= mag;
-                        float dot = (mvelx * normx) + (mvely * normy);
-
-                        movingVel->x = mvelx - normx * (dot * 2.0f);
-                        movingVel->y = mvely - normy * (dot * 2.0f);
-
-                        movingCollision->hp -= 20;
-                        currentstationaryCollision->hp -= 20;
-                        break;
-                    }
-                }
-            }
-        }
-        ++moving;
-        ++movingVel;
-        ++movingCollision;
-    }
+    IModel* model = ballMesh->CreateModel(circle.x, circle.y, 0);
+    model->Scale(circle.rad * 0.05f);
+    model->SetSkin("RedBall.jpg");
+    return model;
 }
 
-//Multithreaded method for checking if circles collide with walls
-void CheckWallCollision(uint32_t numMoving, Circle* moving, CircleVelocity* movingVel)
+static void MoveCamera(I3DEngine* myEngine, ICamera* camera, float frameTime)
 {
-    auto movingEnd = moving + numMoving;
-
-    while (moving != movingEnd)
-    {
-        float mvelx = movingVel->x;
-        float mvely = movingVel->y;
-
-        float mx = moving->x;
-        float my = moving->y;
-
-        float mrad = moving->rad;
-
-        if (mx - mrad <= WALL_MIN_X)
-        {
-            //Move the circle so it is no longer colliding
-            moving->x = WALL_MIN_X + mrad + 1.0f;
-
-            //Refeclt velocity of the moving circle         
-            movingVel->x = mvelx - 1.0f * (mvelx * 2.0f);
-            movingVel->y = mvely - 0.0f * (mvelx * 2.0f);
-        }
-        else if (mx + mrad >= WALL_MAX_X)
-        {
-            //Move the circle so it is no longer colliding
-            moving->x = WALL_MAX_X - mrad - 1.0f;
-
-            //Refeclt velocity of the moving circle
-            movingVel->x = mvelx + 1 * (-mvelx * 2.0f);
-            movingVel->y = mvely - 0.0f * (-mvelx * 2.0f);
-        }
-        else if (my - mrad <= WALL_MIN_Y)
-        {
-            //Move the circle so it is no longer colliding
-            moving->y = WALL_MIN_Y + mrad + 1.0f;
-
-            //Refeclt velocity of the moving circle
-            movingVel->x = mvelx - 0.0f * (mvely * 2.0f);
-            movingVel->y = mvely - 1.0f * (mvely * 2.0f);
-        }
-        else if (my + mrad >= WALL_MAX_Y)
-        {
-            //Move the circle so it is no longer colliding
-            moving->y = WALL_MAX_Y - mrad - 1.0f;
-
-            //Refeclt velocity of the moving circle
-            movingVel->x = mvelx - 0.0f * (-mvely * 2.0f);
-            movingVel->y = mvely + 1.0f * (-mvely * 2.0f);
-        }
-        ++moving;
-        ++movingVel;
-    }
+    if (myEngine->KeyHeld(Key_Q))  camera->MoveLocalZ(frameTime * std::abs(camera->GetZ()));
+    if (myEngine->KeyHeld(Key_E))  camera->MoveLocalZ(-frameTime * std::abs(camera->GetZ()));
+    if (myEngine->KeyHeld(Key_D))  camera->MoveLocalX(frameTime * std::abs(camera->GetZ()));
+    if (myEngine->KeyHeld(Key_A))  camera->MoveLocalX(-frameTime * std::abs(camera->GetZ()));
+    if (myEngine->KeyHeld(Key_W))  camera->MoveLocalY(frameTime * std::abs(camera->GetZ()));
+    if (myEngine->KeyHeld(Key_S))  camera->MoveLocalY(-frameTime * std::abs(camera->GetZ()));
 }
 
-//Multithreaded method for moving models
-void MoveModel(uint32_t numMoving, Circle* moving, IModel** movingModel)
+//Plays a recorded trajectory back one frame per drawn frame, with no simulation, and holds the last frame at the end.
+//Left and right jump a keyframe interval back or forward. Only moving circles are recorded, so nothing else is drawn
+static void ReplayTrajectory(I3DEngine* myEngine, ICamera* camera, IMesh* ballMesh, const char* path)
 {
-    auto movingEnd = moving + numMoving;
-
-    while (moving != movingEnd)
+    TrajectoryReader reader;
+    if (!OpenTrajectory(reader, path))
     {
-        movingModel[0]->SetX(moving->x);
-        movingModel[0]->SetY(moving->y);
-
-        ++moving;
-        ++movingModel;
+        return;
     }
-}
 
-void DeathModel(uint32_t numMoving, Circle* moving, IModel** movingModel, CircleVelocity* movingVel, CircleCollisionData* movingCollision, uint32_t numStationary, Circle* stationary, CircleCollisionData* stationaryCollision, IModel** stationaryModel)
-{
-    auto movingEnd = moving + numMoving;
+    std::vector<IModel*> movingModels(reader.radii.size(), nullptr);
+    std::vector<uint8_t> inFrame(reader.radii.size());
+    RenderSink sink = { "TL-Engine", &MoveModels, movingModels.data() };
+    FrameState frame;
+    bool seeked = true; // The models start out matching nothing
 
-    while (moving != movingEnd)
+    myEngine->Timer();
+    while (myEngine->IsRunning() && !myEngine->KeyHeld(Key_Escape))
     {
-        if (movingCollision->hp <= 0)
-        {
-            moving->x = WALL_MAX_X + 999999999;
-            moving->y = WALL_MAX_Y + 999999999;
-
-            movingVel->x = 0;
-            movingVel->y = 0;
-
-            movingModel[0]->SetX(WALL_MAX_X + 999999999);
-            movingModel[0]->SetY(WALL_MAX_Y + 999999999);
-        }
-
-        ++moving;
-        ++movingVel;
-        ++movingCollision;
-        ++movingModel;
-    }
-
-    //auto stationaryEnd = stationary + numStationary;
-    //while (stationary != stationaryEnd)
-    //{
-    //    if (stationaryCollision->hp <= 0)
-    //    {
-    //        stationary->x = WALL_MIN_X - 999999999;
-    //        stationary->y = WALL_MIN_Y - 999999999;
-
-    //        stationaryModel[0]->SetX(WALL_MIN_X - 999999999);
-    //        stationaryModel[0]->SetY(WALL_MIN_Y - 999999999);
-    //    }
-
-    //    ++stationary;
-    //    ++stationaryCollision;
-    //    ++stationaryModel;
-    //}
-}
+        float frameTime = myEngine->Timer();
+        myEngine->DrawScene();
+        MoveCamera(myEngine, camera, frameTime);
 
-//*********************************************************
-// Worker threads run this method
-// The worker waits for work to be available, processes the work, then signals it is complete.
-// It then returns to waiting. This thread is created at start-up time and destroyed at shutdown,
-// because creating threads at runtime is too slow for this kind of game usage
-void CollisionThread(uint32_t thread)
-{
-    auto& worker = collisionWorkers[thread].first;
-    auto& work = collisionWorkers[thread].second;
-    while (true)
-    {
-        {
-            std::unique_lock<std::mutex> l(worker.lock);
-            worker.workReady.wait(l, [&]() { return !work.complete; }); // Wait until a workReady signal arrives, then verify it by testing      
-            // that work.complete is false. The test is required because there is
-            // the possibility of "spurious wakeups": a false signal. Also in 
-            // some situations other threads may have eaten the work already.
-        }
-        // We have some work so do it...
-        if (VISUALIZER)
-        {
-            CheckCircleCollision(work.frametime, work.numMoving, work.moving, work.movingVel, work.movingCollision, work.numStationary, work.stationary, work.stationaryCollision);
-        }
-        else
+        if (myEngine->KeyHit(Key_Left))
         {
-            CheckCircleCollision(work.frametime, work.numMoving, work.moving, work.movingVel, work.movingCollision, work.numStationary, work.stationary, work.stationaryCollision, work.output);
+            uint32_t current = reader.frame > 0 ? reader.frame - 1 : 0;
+            seeked = SeekTrajectory(reader, current > TRAJECTORY_KEYFRAME_INTERVAL ? current - TRAJECTORY_KEYFRAME_INTERVAL : 0) || seeked;
         }
-        if (WALLS)
+        if (myEngine->KeyHit(Key_Right))
         {
-            CheckWallCollision(work.numMoving, work.moving, work.movingVel);
+            seeked = SeekTrajectory(reader, reader.frame + TRAJECTORY_KEYFRAME_INTERVAL - 1) || seeked;
         }
+        if (!ReadTrajectoryFrame(reader, frame))
         {
-            // Flag the work is complete
-            // We also guard every normal access to shared variable "work.complete" with the same mutex
-            std::unique_lock<std::mutex> l(worker.lock);
-            work.complete = true;
+            continue;
         }
-        // Send a signal back to the main thread to say the work is complete, loop back and wait for more work
-        worker.workReady.notify_one();
-    }
-}
 
-void ModelThread(uint32_t thread)
-{
-    auto& worker = modelWorkers[thread].first;
-    auto& work = modelWorkers[thread].second;
-    while (true)
-    {
+        if (seeked)
         {
-            std::unique_lock<std::mutex> l(worker.lock);
-            worker.workReady.wait(l, [&]() { return !work.complete; }); // Wait until a workReady signal arrives, then verify it by testing      
-            // that work.complete is false. The test is required because there is
-            // the possibility of "spurious wakeups": a false signal. Also in 
-            // some situations other threads may have eaten the work already.
+            // Jumped, so circles dead here may have models and live ones may not
+            std::fill(inFrame.begin(), inFrame.end(), 0);
+            for (uint32_t i = 0; i < frame.numMoving; ++i)
+            {
+                uint32_t id = frame.movingIds[i];
+                inFrame[id] = 1;
+                if (!movingModels[id])  movingModels[id] = CreateMovingModel(ballMesh, frame.movingCircles[i]);
+            }
+            for (uint32_t id = 0; id < movingModels.size(); ++id)
+            {
+                if (movingModels[id] && !inFrame[id])
+                {
+                    ballMesh->RemoveModel(movingModels[id]);
+                    movingModels[id] = nullptr;
+                }
+            }
+            seeked = false;
         }
-        // We have some work so do it...
-        if (DEATH)
+        else
         {
-            DeathModel(work.numMoving, work.moving, work.movingModel, work.movingVel, work.movingCollision, work.numStationary, work.stationary, work.stationaryCollision, work.stationaryModel);
+            for (uint32_t id : frame.removedMoving)
+            {
+                ballMesh->RemoveModel(movingModels[id]);
+                movingModels[id] = nullptr;
+            }
         }
-        MoveModel(work.numMoving, work.moving, work.movingModel);
 
-        {
-            // Flag the work is complete
-            // We also guard every normal access to shared variable "work.complete" with the same mutex
-            std::unique_lock<std::mutex> l(worker.lock);
-            work.complete = true;
-        }
-        // Send a signal back to the main thread to say the work is complete, loop back and wait for more work
-        worker.workReady.notify_one();
+        SubmitFrame(sink, frame);
     }
+    CloseTrajectory(reader);
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -712,6 +129,14 @@ void ModelThread(uint32_t thread)
 
 void main()
 {
+    // Scenario options, the defaults unless the config file is there
+    SimulationOptions options;
+    std::ifstream optionsFile(OPTIONS_FILE);
+    if (optionsFile.good() && !(LoadOptions(options, OPTIONS_FILE) && ValidateOptions(options)))
+    {
+        return;
+    }
+
     // Create a 3D engine (using TLX engine here) and open a window for it
     I3DEngine* myEngine = New3DEngine(kTLX);
     myEngine->StartWindowed();
@@ -728,254 +153,124 @@ void main()
     camera->SetY(0);
     camera->SetZ(-250);
 
+    IMesh* ballMesh = myEngine->LoadMesh("PoolBall.x");
+    if (!options.replay.empty())
+    {
+        ReplayTrajectory(myEngine, camera, ballMesh, options.replay.c_str());
+        myEngine->Delete();
+        return;
+    }
+
     // Start worker threads
-    mNumWorkers = std::thread::hardware_concurrency(); // Gives a hint about level of thread concurrency supported by system (0 means no hint given)
-    if (mNumWorkers == 0)  mNumWorkers = 8;
-    --mNumWorkers; // Decrease by one because this main thread is already running
-    for (uint32_t i = 0; i < mNumWorkers; ++i)
+    uint32_t numThreads = std::thread::hardware_concurrency(); // Gives a hint about level of thread concurrency supported by system (0 means no hint given)
+    if (numThreads == 0)  numThreads = 8;
+    if (numThreads > MAX_THREADS)  numThreads = MAX_THREADS;
+    bool profile = !options.profileTrace.empty() || !options.profileSummary.empty();
+    if (profile)
     {
-        // Start each worker thread running the CollisionThread method. Note the way to construct std::thread to run a member function
-        collisionWorkers[i].first.thread = std::thread(&CollisionThread, i);
-        modelWorkers[i].first.thread = std::thread(&ModelThread, i);
+        StartProfiler(PROFILE_EVENTS_PER_THREAD);
+        ProfileThreadName("Main");
     }
+    scheduler.pinThreads = options.pinThreads;
+    StartScheduler(numThreads - 1); // Less one because this main thread is already running
+    if (options.hugePages)  EnableHugePages(true);
 
-    std::sort(stationaryCircles, stationaryCircles + STATIONARY_NUM, &CircleSorter);
+    World world;
+    if (options.snapshot.empty())
+    {
+        GenerateWorld(world, options, 1);
+        PrepareWorld(world);
+    }
+    else if (!LoadSnapshot(world, options, options.snapshot.c_str()))
+    {
+        StopScheduler();
+        myEngine->Delete();
+        return;
+    }
 
-    IMesh* ballMesh = myEngine->LoadMesh("PoolBall.x");
-    IModel* movingModels[MOVING_NUM];
-    IModel* stationaryModels[STATIONARY_NUM];
-    if (VISUALIZER)
+    narrowPhase = SelectNarrowPhaseKernel(options.maxSimd);
+    std::cout << "Narrow phase: " << narrowPhase.name << std::endl;
+
+    // Indexed by id, a restored world can have ids past its live counts
+    std::vector<IModel*> movingModels(world.movingNames.size(), nullptr);
+    std::vector<IModel*> stationaryModels(world.stationaryIndex.size(), nullptr);
+    for (uint32_t i = 0; i < world.numMoving; ++i)
     {
-        for (int i = 0; i < MOVING_NUM; ++i)
-        {
-            movingModels[i] = ballMesh->CreateModel(movingCircles[i].x, movingCircles[i].y, 0);
-            movingModels[i]->Scale(movingCircles[i].rad * 0.05f);
-            movingModels[i]->SetSkin("RedBall.jpg");
-        }
+        movingModels[world.movingIds[i]] = CreateMovingModel(ballMesh, world.movingCircles[i]);
+    }
 
-        for (int i = 0; i < STATIONARY_NUM; ++i)
+    // Stationary models are indexed by id too, as inserts and removals move stationary circles around their arrays
+    auto createStationaryModel = [&](uint32_t id, const Circle& circle)
+    {
+        IModel*& model = stationaryModels[id];
+        model = ballMesh->CreateModel(circle.x, circle.y, 0);
+        model->Scale(circle.rad * 0.05f);
+        model->SetSkin("BlackBall.jpg");
+    };
+    for (uint32_t i = 0; i < world.numStationary; ++i)
+    {
+        if (world.stationaryIndex[world.stationaryIds[i]] == i) // Not a tombstone
         {
-            stationaryModels[i] = ballMesh->CreateModel(stationaryCircles[i].x, stationaryCircles[i].y, 0);
-            stationaryModels[i]->Scale(stationaryCircles[i].rad * 0.05f);
-            stationaryModels[i]->SetSkin("BlackBall.jpg");
+            createStationaryModel(world.stationaryIds[i], world.stationaryCircles[i]);
         }
     }
-    else
-    {
-        start = std::chrono::steady_clock::now();
-    }
+
+    // Pipelined, the models are moved to the last step while the workers run the next one
+    SimulationPipeline pipeline;
+    StartPipeline(pipeline, world, !options.pipeline);
+    RenderSink sink = { "TL-Engine", &MoveModels, movingModels.data() };
+    TrajectoryRecorder recorder;
+    bool recordTrajectory = !options.trajectory.empty() && StartTrajectoryRecorder(recorder, options.trajectory.c_str(), world);
 
     myEngine->Timer();
     // The main game loop, repeat until engine is stopped
-    int tickNum = 0;
-    long totalTicktime = 0;
     while (myEngine->IsRunning() && !myEngine->KeyHeld(Key_Escape))
     {
-        auto tickStart = std::chrono::steady_clock::now();
         float frameTime = myEngine->Timer();
 
-        if (VISUALIZER)
-        {
-            // Draw the scene
-            myEngine->DrawScene();
-
-            if (myEngine->KeyHeld(Key_Q))  camera->MoveLocalZ(frameTime * std::abs(camera->GetZ()));
-            if (myEngine->KeyHeld(Key_E))  camera->MoveLocalZ(-frameTime * std::abs(camera->GetZ()));
-            if (myEngine->KeyHeld(Key_D))  camera->MoveLocalX(frameTime * std::abs(camera->GetZ()));
-            if (myEngine->KeyHeld(Key_A))  camera->MoveLocalX(-frameTime * std::abs(camera->GetZ()));
-            if (myEngine->KeyHeld(Key_W))  camera->MoveLocalY(frameTime * std::abs(camera->GetZ()));
-            if (myEngine->KeyHeld(Key_S))  camera->MoveLocalY(-frameTime * std::abs(camera->GetZ()));
-        }
-
-        /**** Update your scene each frame here ****/
-
-        auto movingStart = movingCircles;
-        auto movingVelStart = movingVelocitys;
-        auto movingCollisionStart = movingCollisions;
-        for (uint32_t j = 0; j < mNumWorkers; ++j)
-        {
-            // Prepare a section of work (basically the parameters to the collision detection function)
-            auto& work = collisionWorkers[j].second;
-            work.frametime = frameTime;
-            work.numMoving = MOVING_NUM / (mNumWorkers + 1);// Add one because this main thread will also do some work
-            work.moving = movingStart;
-            work.movingVel = movingVelStart;
-            work.movingCollision = movingCollisionStart;
-            work.numStationary = STATIONARY_NUM;
-            work.stationary = stationaryCircles;
-            work.stationaryCollision = stationaryCollisions;
-            work.output = collisionsOutput[j];
-
-            // Flag the work as not yet complete
-            auto& workerThread = collisionWorkers[j].first;
-            {
-                // Guard every access to shared variable "work.complete" with a mutex (see BlockSpritesThread comments)
-                std::unique_lock<std::mutex> l(workerThread.lock);
-                work.complete = false;
-            }
-
-            // Notify the worker thread via a condition variable - this will wake the worker thread up
-            workerThread.workReady.notify_one();
+        // Draw the scene
+        myEngine->DrawScene();
 
-            movingStart += work.numMoving;
-            movingVelStart += work.numMoving;
-            movingCollisionStart += work.numMoving;
-        }
+        MoveCamera(myEngine, camera, frameTime);
 
-        // This main thread will also do one section of the work
-        uint32_t numRemaining = MOVING_NUM / (mNumWorkers + 1);
-        if (VISUALIZER)
-        {
-            CheckCircleCollision(frameTime, numRemaining, movingCircles, movingVelocitys, movingCollisions, STATIONARY_NUM, stationaryCircles, stationaryCollisions);
-        }
-        else
-        {
-            CheckCircleCollision(frameTime, numRemaining, movingCircles, movingVelocitys, movingCollisions, STATIONARY_NUM, stationaryCircles, stationaryCollisions, collisionsOutput[mNumWorkers]);
-        }
-        if (WALLS)
-        {
-            CheckWallCollision(numRemaining, movingCircles, movingVelocitys);
-        }
+        /**** Update your scene each frame here ****/
 
-        // Wait for all the workers to finish
-        for (uint32_t j = 0; j < mNumWorkers; ++j)
-        {
-            auto& workerThread = collisionWorkers[j].first;
-            auto& work = collisionWorkers[j].second;
-
-            // Wait for a signal via a condition variable indicating that the worker has finished the work
-            // See comments in BlockSpritesThread regarding the mutex and the wait method
-            std::unique_lock<std::mutex> l(workerThread.lock);
-            workerThread.workReady.wait(l, [&]() { return work.complete; });
-            collisionsOutput[j] = work.output;
-        }
+        FinishStep(pipeline);
+        if (myEngine->KeyHit(Key_F5))  SaveSnapshot(world, CHECKPOINT_FILE); // The world is between steps here
+        LaunchStep(pipeline, frameTime);
+        const FrameState& frame = FrontFrame(pipeline);
 
-        if (VISUALIZER)
+        // Dead circles are gone from the simulation, so their models go too
         {
-            movingStart = movingCircles;
-            movingVelStart = movingVelocitys;
-            movingCollisionStart = movingCollisions;
-            auto movingModelStart = movingModels;
-
-            auto stationaryStart = stationaryCircles;
-            auto stationaryCollisionStart = stationaryCollisions;
-            auto stationaryModelStart = stationaryModels;
-            for (uint32_t j = 0; j < mNumWorkers; ++j)
+            PROFILE_SCOPE(PROFILE_MODEL_UPDATES);
+            for (uint32_t id : frame.removedMoving)
             {
-                // Prepare a section of work (basically the parameters to the collision detection function)
-                auto& work = modelWorkers[j].second;
-                work.numMoving = MOVING_NUM / (mNumWorkers + 1);// Add one because this main thread will also do some work
-                work.moving = movingStart;
-                work.movingVel = movingVelStart;
-                work.movingCollision = movingCollisionStart;
-                work.movingModel = movingModelStart;
-                work.numStationary = STATIONARY_NUM / (mNumWorkers + 1);// Add one because this main thread will also do some work;
-                work.stationary = stationaryStart;
-                work.stationaryCollision = stationaryCollisionStart;
-                work.stationaryModel = stationaryModelStart;
-
-                // Flag the work as not yet complete
-                auto& workerThread = modelWorkers[j].first;
-                {
-                    // Guard every access to shared variable "work.complete" with a mutex (see BlockSpritesThread comments)
-                    std::unique_lock<std::mutex> l(workerThread.lock);
-                    work.complete = false;
-                }
-
-                // Notify the worker thread via a condition variable - this will wake the worker thread up
-                workerThread.workReady.notify_one();
-
-                movingStart += work.numMoving;
-                movingVelStart += work.numMoving;
-                movingCollisionStart += work.numMoving;
-                movingModelStart += work.numMoving;
-
-                stationaryStart += work.numStationary;
-                stationaryCollisionStart += work.numStationary;
-                stationaryModelStart += work.numStationary;
+                ballMesh->RemoveModel(movingModels[id]);
+                movingModels[id] = nullptr;
             }
-
-            // This main thread will also do one section of the work
-            uint32_t movingNumRemaining = MOVING_NUM / (mNumWorkers + 1);
-            uint32_t stationaryNumRemaining = STATIONARY_NUM / (mNumWorkers + 1);
-            if (DEATH)
+            for (uint32_t id : frame.removedStationary)
             {
-                DeathModel(movingNumRemaining, movingCircles, movingModels, movingVelocitys, movingCollisions, stationaryNumRemaining, stationaryCircles, stationaryCollisions, stationaryModels);
+                ballMesh->RemoveModel(stationaryModels[id]);
+                stationaryModels[id] = nullptr;
             }
-            MoveModel(movingNumRemaining, movingCircles, movingModels);
-
-            // Wait for all the workers to finish
-            for (uint32_t j = 0; j < mNumWorkers; ++j)
+            stationaryModels.resize(frame.numStationaryIds);
+            for (size_t i = 0; i < frame.insertedStationary.size(); ++i)
             {
-                auto& workerThread = modelWorkers[j].first;
-                auto& work = modelWorkers[j].second;
-
-                // Wait for a signal via a condition variable indicating that the worker has finished the work
-                // See comments in BlockSpritesThread regarding the mutex and the wait method
-                std::unique_lock<std::mutex> l(workerThread.lock);
-                workerThread.workReady.wait(l, [&]() { return work.complete; });
+                createStationaryModel(frame.insertedStationary[i], frame.insertedCircles[i]);
             }
         }
-        else
-        {
-            for (uint32_t i = 0; i < mNumWorkers + 1; ++i)
-            {
-                for (auto j : collisionsOutput[i])
-                {
-                    std::cout << j << std::endl;
-                }
-
-                collisionsOutput[i].clear();
-            }
-
-            if (DEATH)
-            {
-                for (int i = 0; i < MOVING_NUM; ++i)
-                {
-                    movingCircles[i].x = WALL_MAX_X + 999999999;
-                    movingCircles[i].y = WALL_MAX_Y + 999999999;
-
-                    movingVelocitys[i].x = 0;
-                    movingVelocitys[i].y = 0;
-                }
-
-                //for (int i = 0; i < STATIONARY_NUM; ++i)
-                //{
-                //    stationaryCircles[i].x = WALL_MIN_X - 999999999;
-                //    stationaryCircles[i].y = WALL_MIN_Y - 999999999;
-                //}
-            }
-
-            auto end = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - tickStart);
 
-            totalTicktime += elapsed.count();
-            ++tickNum;
-        }
+        SubmitFrame(sink, frame);
+        if (recordTrajectory)  RecordTrajectoryFrame(recorder, frame);
     }
 
-    if (!VISUALIZER)
-    {
-        auto end = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-
-        std::cout << "Time taken: " << elapsed.count() << " microseconds" << std::endl;
-
-        std::cout << "Average tick time: " << totalTicktime / tickNum << " microseconds" << std::endl;
-    }
+    // Running threads must be joined to the main thread before their destruction
+    StopPipeline(pipeline);
+    if (recordTrajectory)  StopTrajectoryRecorder(recorder);
+    StopScheduler();
+    if (!options.profileTrace.empty())  WriteProfileTrace(options.profileTrace.c_str());
+    if (!options.profileSummary.empty())  WriteProfileSummary(options.profileSummary.c_str());
 
     // Delete the 3D engine now we are finished with it
-
-    //*********************************************************
-    // Running threads must be joined to the main thread or detached before their destruction. If not
-    // the entire program immediately terminates (in fact the program is quiting here anyway, but if 
-    // std::terminate is called we probably won't get proper destruction). The worker threads never
-    // naturally exit so we can't use join. So in this case detach them prior to their destruction.
-    for (uint32_t i = 0; i < mNumWorkers; ++i)
-    {
-        collisionWorkers[i].first.thread.detach();
-        modelWorkers[i].first.thread.detach();
-    }
-
     myEngine->Delete();
-}
\ No newline at end of file
+}
@@ -0,0 +1,664 @@
+// Domain.cpp: Splits the world into x-strips, each simulated by its own process, that trade border circles over shared memory
+
+#include "Domain.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+// Strips
+//---------------------------------------------------------------------------------------------------------------------
+
+//Lower edge of strip k, worked out the same way in every process so neighbours agree on it exactly
+static float DomainEdge(const SimulationOptions& options, uint32_t k, uint32_t numDomains)
+{
+    if (k == 0)  return -std::numeric_limits<float>::infinity();
+    if (k == numDomains)  return std::numeric_limits<float>::infinity();
+    return static_cast<float>(options.minX + static_cast<double>(options.maxX - options.minX) * k / numDomains);
+}
+
+float DomainHalo(const SimulationOptions& options, float frameTime)
+{
+    // Reflections keep a circle's speed, so none moves faster than it was generated. Plus one for rounding
+    float maxVelX = static_cast<float>(std::max(std::abs(MINVEL_X), std::abs(MAXVEL_X)));
+    float maxVelY = static_cast<float>(std::max(std::abs(MINVEL_Y), std::abs(MAXVEL_Y)));
+    float time = options.fixedTimestep > 0.0f ? options.fixedTimestep * MAX_FIXED_STEPS : frameTime;
+    return std::sqrt(maxVelX * maxVelX + maxVelY * maxVelY) * time + 2.0f * MaxRadius(options) + 1.0f;
+}
+
+void ApplyDomainDefaults(SimulationOptions& options, uint32_t numDomains)
+{
+    if (numDomains <= 1)
+    {
+        return;
+    }
+    if (options.movingCollisions)
+    {
+        std::cout << "Processes turn moving-collisions off, moving pairs are resolved in one pass over the whole world" << std::endl;
+        options.movingCollisions = false;
+    }
+    if (options.collisionLog != CollisionLogFormat::None)
+    {
+        std::cout << "Processes turn the collision log off, each would write its own log" << std::endl;
+        options.collisionLog = CollisionLogFormat::None;
+    }
+}
+
+bool ValidateDomains(const SimulationOptions& options, float frameTime, uint32_t numDomains)
+{
+    if (numDomains == 0 || numDomains > MAX_DOMAINS)
+    {
+        std::cout << "Between 1 and " << MAX_DOMAINS << " processes are supported" << std::endl;
+        return false;
+    }
+    if (numDomains == 1)
+    {
+        return true;
+    }
+    if (options.movingCollisions)
+    {
+        std::cout << "Processes need moving-collisions off, moving pairs are resolved in one pass over the whole world" << std::endl;
+        return false;
+    }
+    if (options.collisionLog != CollisionLogFormat::None)
+    {
+        std::cout << "Processes need log none, each would write its own log" << std::endl;
+        return false;
+    }
+    if (options.death && options.fixedTimestep > 0.0f)
+    {
+        std::cout << "Processes can't combine death with fixed-timestep, a band circle killed in one sub-step needs both sides' hits to stop being hit in the next" << std::endl;
+        return false;
+    }
+    if (!options.snapshot.empty() || !options.trajectory.empty() || !options.profileTrace.empty() || !options.profileSummary.empty())
+    {
+        std::cout << "Processes can't load snapshots, record trajectories or profile" << std::endl;
+        return false;
+    }
+
+    // Only neighbours may share a band, so a strip must be at least two halos wide
+    float width = static_cast<float>(options.maxX - options.minX) / numDomains;
+    float halo = DomainHalo(options, frameTime);
+    if (width < 2.0f * halo)
+    {
+        std::cout << "Strips of " << width << " are narrower than twice the halo of " << halo << ", use fewer processes" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Shared Memory
+//---------------------------------------------------------------------------------------------------------------------
+
+const std::size_t RING_STRIDE = sizeof(DomainRing) + DOMAIN_RING_SIZE;
+
+//Ring carrying boundary b's traffic upwards (from domain b to b + 1) or downwards
+static DomainRing* Ring(DomainShared& shared, uint32_t boundary, bool upwards)
+{
+    return reinterpret_cast<DomainRing*>(shared.rings + (boundary * 2 + (upwards ? 0 : 1)) * RING_STRIDE);
+}
+
+static uint8_t* RingData(DomainRing& ring)
+{
+    return reinterpret_cast<uint8_t*>(&ring + 1);
+}
+
+//Rounds up to whole cache lines, so each table starts on one
+static std::size_t LineSize(std::size_t bytes)
+{
+    return (bytes + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+bool CreateDomainShared(DomainShared& shared, const SimulationOptions& options, uint32_t numDomains)
+{
+    uint32_t numRings = (numDomains - 1) * 2;
+    shared.numDomains = numDomains;
+    shared.numMovingIds = options.circles / 2;
+    shared.numStationaryIds = options.circles - shared.numMovingIds;
+
+    std::size_t ringBytes = numRings * RING_STRIDE;
+    std::size_t statsBytes = LineSize(numDomains * sizeof(DomainStats));
+    std::size_t movingBytes = LineSize(shared.numMovingIds * sizeof(MovingResult));
+    std::size_t stationaryBytes = shared.numStationaryIds * sizeof(StationaryResult);
+    shared.size = ringBytes + statsBytes + movingBytes + stationaryBytes;
+
+#if defined(_WIN32)
+    std::cout << "Processes need fork, which Windows doesn't have" << std::endl;
+    return false;
+#else
+    // Anonymous pages come zeroed, and shared ones stay shared with every process forked after this
+    void* memory = mmap(nullptr, shared.size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        std::cout << "Could not map " << shared.size << " bytes of shared memory" << std::endl;
+        return false;
+    }
+    shared.memory = memory;
+
+    uint8_t* bytes = static_cast<uint8_t*>(memory);
+    shared.rings = bytes;
+    shared.stats = reinterpret_cast<DomainStats*>(bytes + ringBytes);
+    shared.moving = reinterpret_cast<MovingResult*>(bytes + ringBytes + statsBytes);
+    shared.stationary = reinterpret_cast<StationaryResult*>(bytes + ringBytes + statsBytes + movingBytes);
+    for (uint32_t ring = 0; ring < numRings; ++ring)
+    {
+        DomainRing* r = new (shared.rings + ring * RING_STRIDE) DomainRing;
+        r->head.store(0);
+        r->tail.store(0);
+    }
+    return true;
+#endif
+}
+
+void DestroyDomainShared(DomainShared& shared)
+{
+#if !defined(_WIN32)
+    if (shared.memory)
+    {
+        munmap(shared.memory, shared.size);
+    }
+#endif
+    shared.memory = nullptr;
+}
+
+//Copies as much of size bytes into the ring as fits, returns how many did
+static std::size_t RingWrite(DomainRing& ring, const uint8_t* from, std::size_t size)
+{
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    uint64_t tail = ring.tail.load(std::memory_order_acquire);
+    std::size_t count = std::min<std::size_t>(size, DOMAIN_RING_SIZE - static_cast<std::size_t>(head - tail));
+    std::size_t offset = static_cast<std::size_t>(head % DOMAIN_RING_SIZE);
+    std::size_t first = std::min(count, DOMAIN_RING_SIZE - offset);
+    std::memcpy(RingData(ring) + offset, from, first);
+    std::memcpy(RingData(ring), from + first, count - first);
+    ring.head.store(head + count, std::memory_order_release);
+    return count;
+}
+
+//Copies up to size bytes out of the ring, returns how many there were
+static std::size_t RingRead(DomainRing& ring, uint8_t* to, std::size_t size)
+{
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    std::size_t count = std::min<std::size_t>(size, static_cast<std::size_t>(head - tail));
+    std::size_t offset = static_cast<std::size_t>(tail % DOMAIN_RING_SIZE);
+    std::size_t first = std::min(count, DOMAIN_RING_SIZE - offset);
+    std::memcpy(to, RingData(ring) + offset, first);
+    std::memcpy(to + first, RingData(ring), count - first);
+    ring.tail.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Setup
+//---------------------------------------------------------------------------------------------------------------------
+
+void StartDomain(Domain& domain, DomainShared& shared, uint32_t index, const SimulationOptions& options, float frameTime)
+{
+    domain.index = index;
+    domain.numDomains = shared.numDomains;
+    domain.minX = DomainEdge(options, index, shared.numDomains);
+    domain.maxX = DomainEdge(options, index + 1, shared.numDomains);
+    domain.halo = DomainHalo(options, frameTime);
+    domain.frame = 0;
+    if (index > 0)
+    {
+        domain.send[0] = Ring(shared, index - 1, false);
+        domain.receive[0] = Ring(shared, index - 1, true);
+    }
+    if (index + 1 < shared.numDomains)
+    {
+        domain.send[1] = Ring(shared, index, true);
+        domain.receive[1] = Ring(shared, index, false);
+    }
+}
+
+//Ids of the stationary circles in [minX, maxX), at their generated hp
+static void RecordBand(const World& world, float minX, float maxX, std::vector<DomainBandCircle>& band)
+{
+    auto xLess = [](const Circle& circle, float x) { return circle.x < x; };
+    const Circle* begin = world.stationaryCircles.data();
+    const Circle* end = begin + world.numStationary;
+    const Circle* first = std::lower_bound(begin, end, minX, xLess);
+    const Circle* last = std::lower_bound(first, end, maxX, xLess);
+    band.clear();
+    for (const Circle* circle = first; circle != last; ++circle)
+    {
+        uint32_t i = static_cast<uint32_t>(circle - begin);
+        band.push_back({ world.stationaryIds[i], world.stationaryHp[i] });
+    }
+}
+
+void GenerateDomainWorld(World& world, Domain& domain, const SimulationOptions& options, uint32_t seed)
+{
+    world.options = options;
+    world.walls = WallBounds(options);
+    uint32_t numMovingIds = options.circles / 2;
+    uint32_t numStationaryIds = options.circles - numMovingIds;
+
+    // Moving circles starting in the strip, kept in id order. Each chunk counts its own, then writes them after the
+    // chunks before it
+    uint32_t numChunks = (numMovingIds + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<uint32_t> chunkStart(numChunks + 1, 0);
+    ParallelFor(0, numMovingIds, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        uint32_t count = 0;
+        for (uint32_t i = chunkBegin; i < chunkEnd; ++i)
+        {
+            float x = RandomCircle(options, seed, RANDOM_MOVING, i).x;
+            count += x >= domain.minX && x < domain.maxX;
+        }
+        chunkStart[chunkBegin / CHUNK_SIZE + 1] = count;
+    });
+    for (uint32_t chunk = 0; chunk < numChunks; ++chunk)
+    {
+        chunkStart[chunk + 1] += chunkStart[chunk];
+    }
+
+    world.numMoving = chunkStart[numChunks];
+    world.movingCircles.resize(world.numMoving);
+    world.movingVelocitys.resize(world.numMoving);
+    world.movingHp.resize(world.numMoving);
+    world.movingIds.resize(world.numMoving);
+    world.movingColours.resize(world.numMoving);
+    ParallelFor(0, numMovingIds, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        uint32_t j = chunkStart[chunkBegin / CHUNK_SIZE];
+        for (uint32_t i = chunkBegin; i < chunkEnd; ++i)
+        {
+            Circle circle = RandomCircle(options, seed, RANDOM_MOVING, i);
+            if (circle.x >= domain.minX && circle.x < domain.maxX)
+            {
+                world.movingCircles[j] = circle;
+                world.movingVelocitys[j] = RandomVelocity(seed, RANDOM_MOVING, i);
+                world.movingHp[j] = 100;
+                world.movingIds[j] = i;
+                world.movingColours[j] = RandomColour(seed, RANDOM_MOVING, i);
+                ++j;
+            }
+        }
+    });
+
+    // Every stationary circle is sorted as PrepareWorld does, so ids match, then the run within a halo of the strip is kept.
+    // A sort of the whole set per domain, but only once
+    AlignedVector<Circle> sorted(numStationaryIds);
+    ParallelFor(0, numStationaryIds, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        for (uint32_t i = chunkBegin; i < chunkEnd; ++i)
+        {
+            sorted[i] = RandomCircle(options, seed, RANDOM_STATIONARY, i);
+        }
+    });
+    ParallelSort(sorted.data(), numStationaryIds, &CircleSorter);
+
+    auto xLess = [](const Circle& circle, float x) { return circle.x < x; };
+    uint32_t first = static_cast<uint32_t>(std::lower_bound(sorted.begin(), sorted.end(), domain.minX - domain.halo, xLess) - sorted.begin());
+    uint32_t last = static_cast<uint32_t>(std::lower_bound(sorted.begin() + first, sorted.end(), domain.maxX + domain.halo, xLess) - sorted.begin());
+
+    world.numStationary = last - first;
+    world.stationaryCircles.resize(world.numStationary);
+    world.stationaryHp.resize(world.numStationary);
+    world.stationaryIds.resize(world.numStationary);
+    world.stationaryColours.resize(world.numStationary);
+    world.stationaryIndex.assign(numStationaryIds, NO_STATIONARY);
+    ParallelFor(0, world.numStationary, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        for (uint32_t i = chunkBegin; i < chunkEnd; ++i)
+        {
+            uint32_t id = first + i;
+            world.stationaryCircles[i] = sorted[id];
+            world.stationaryHp[i] = 100;
+            world.stationaryIds[i] = id;
+            world.stationaryColours[i] = RandomColour(seed, RANDOM_STATIONARY, id);
+            world.stationaryIndex[id] = i;
+        }
+    });
+    world.numTombstones = 0;
+
+    if (options.reorderInterval > 0)
+    {
+        ReorderMovingByMorton(world);
+    }
+    RestoreWorld(world);
+
+    if (domain.send[0])
+    {
+        RecordBand(world, domain.minX - domain.halo, domain.minX + domain.halo, domain.band[0]);
+    }
+    if (domain.send[1])
+    {
+        RecordBand(world, domain.maxX - domain.halo, domain.maxX + domain.halo, domain.band[1]);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Exchange
+//---------------------------------------------------------------------------------------------------------------------
+
+// Each frame each direction carries one message: a header, the moving circles crossing the boundary, then the hp each
+// band circle lost on the sending side
+
+struct DomainMessageHeader
+{
+    uint32_t frame;
+    uint32_t numMigrants;
+    uint32_t numDamages;
+    uint32_t padding;
+};
+
+struct DomainMigrant
+{
+    uint32_t id;
+    int32_t hp;
+    Circle circle;
+    CircleVelocity velocity;
+    CircleColourData colour;
+};
+
+struct DomainDamage
+{
+    uint32_t id;
+    int32_t damage;
+};
+
+template <typename T>
+static void Append(std::vector<uint8_t>& bytes, const T& value)
+{
+    std::size_t size = bytes.size();
+    bytes.resize(size + sizeof(T));
+    std::memcpy(bytes.data() + size, &value, sizeof(T));
+}
+
+//Starts both messages and moves the moving circles that left the strip into them
+static void SendMigrants(Domain& domain, World& world)
+{
+    for (uint32_t side = 0; side < 2; ++side)
+    {
+        domain.outgoing[side].clear();
+        Append(domain.outgoing[side], DomainMessageHeader{ domain.frame, 0, 0, 0 });
+    }
+
+    uint32_t numKept = 0;
+    uint32_t numSent[2] = {};
+    for (uint32_t i = 0; i < world.numMoving; ++i)
+    {
+        const Circle& circle = world.movingCircles[i];
+        if (circle.x >= domain.minX && circle.x < domain.maxX)
+        {
+            if (numKept != i)
+            {
+                world.movingCircles[numKept] = world.movingCircles[i];
+                world.movingVelocitys[numKept] = world.movingVelocitys[i];
+                world.movingHp[numKept] = world.movingHp[i];
+                world.movingIds[numKept] = world.movingIds[i];
+                world.movingColours[numKept] = world.movingColours[i];
+            }
+            ++numKept;
+            continue;
+        }
+
+        // A circle only crosses into the neighbouring strip, strips are wider than a move
+        uint32_t side = circle.x < domain.minX ? 0 : 1;
+        DomainMigrant migrant;
+        migrant.id = world.movingIds[i];
+        migrant.hp = world.movingHp[i];
+        migrant.circle = circle;
+        migrant.velocity = world.movingVelocitys[i];
+        migrant.colour = world.movingColours[i];
+        Append(domain.outgoing[side], migrant);
+        ++numSent[side];
+    }
+
+    if (numKept != world.numMoving)
+    {
+        world.numMoving = numKept;
+        world.movingCircles.resize(numKept);
+        world.movingVelocitys.resize(numKept);
+        world.movingHp.resize(numKept);
+        world.movingIds.resize(numKept);
+        world.movingColours.resize(numKept);
+    }
+    for (uint32_t side = 0; side < 2; ++side)
+    {
+        reinterpret_cast<DomainMessageHeader*>(domain.outgoing[side].data())->numMigrants = numSent[side];
+        domain.stats.migrated += numSent[side];
+    }
+}
+
+//Adds the hp each band circle lost since the last exchange to its side's message
+static void SendDamage(Domain& domain, const World& world)
+{
+    for (uint32_t side = 0; side < 2; ++side)
+    {
+        uint32_t numDamages = 0;
+        for (const DomainBandCircle& circle : domain.band[side])
+        {
+            uint32_t index = world.stationaryIndex[circle.id];
+            if (index != NO_STATIONARY && world.stationaryHp[index] != circle.hp)
+            {
+                Append(domain.outgoing[side], DomainDamage{ circle.id, circle.hp - world.stationaryHp[index] });
+                ++numDamages;
+            }
+        }
+        reinterpret_cast<DomainMessageHeader*>(domain.outgoing[side].data())->numDamages = numDamages;
+        domain.stats.damageSent += numDamages;
+    }
+}
+
+//Streams both outgoing messages out and both incoming ones in at once, so neither neighbour waits on the other's ring
+//emptying. Yields whenever no ring had anything to give or room to take
+static void TransferMessages(Domain& domain)
+{
+    std::size_t sent[2] = {};
+    std::size_t received[2] = {};
+    std::size_t expected[2] = {};
+    for (uint32_t side = 0; side < 2; ++side)
+    {
+        expected[side] = domain.receive[side] ? sizeof(DomainMessageHeader) : 0;
+        domain.incoming[side].resize(expected[side]);
+        if (!domain.send[side])
+        {
+            sent[side] = domain.outgoing[side].size();
+        }
+    }
+
+    bool done = false;
+    while (!done)
+    {
+        done = true;
+        bool progress = false;
+        for (uint32_t side = 0; side < 2; ++side)
+        {
+            std::vector<uint8_t>& out = domain.outgoing[side];
+            if (sent[side] < out.size())
+            {
+                std::size_t count = RingWrite(*domain.send[side], out.data() + sent[side], out.size() - sent[side]);
+                sent[side] += count;
+                progress |= count > 0;
+            }
+
+            std::vector<uint8_t>& in = domain.incoming[side];
+            if (received[side] < expected[side])
+            {
+                std::size_t count = RingRead(*domain.receive[side], in.data() + received[side], expected[side] - received[side]);
+                received[side] += count;
+                progress |= count > 0;
+
+                // Once the header is in, the rest of the message's size is known
+                if (count > 0 && received[side] == sizeof(DomainMessageHeader))
+                {
+                    DomainMessageHeader header;
+                    std::memcpy(&header, in.data(), sizeof(header));
+                    expected[side] += header.numMigrants * sizeof(DomainMigrant) + header.numDamages * sizeof(DomainDamage);
+                    in.resize(expected[side]);
+                }
+            }
+            done &= sent[side] == out.size() && received[side] == expected[side];
+        }
+        if (!done && !progress)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+//Appends the moving circles a neighbour sent and takes off the hp its band circles lost. Returns false if the message is
+//for another frame
+static bool ReceiveMessage(Domain& domain, World& world, uint32_t side)
+{
+    const uint8_t* bytes = domain.incoming[side].data();
+    DomainMessageHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (header.frame != domain.frame)
+    {
+        std::cout << "Domain " << domain.index << " got frame " << header.frame << " from a neighbour on frame " << domain.frame << std::endl;
+        return false;
+    }
+    bytes += sizeof(header);
+
+    for (uint32_t i = 0; i < header.numMigrants; ++i, bytes += sizeof(DomainMigrant))
+    {
+        DomainMigrant migrant;
+        std::memcpy(&migrant, bytes, sizeof(migrant));
+        world.movingCircles.push_back(migrant.circle);
+        world.movingVelocitys.push_back(migrant.velocity);
+        world.movingHp.push_back(migrant.hp);
+        world.movingIds.push_back(migrant.id);
+        world.movingColours.push_back(migrant.colour);
+    }
+    world.numMoving += header.numMigrants;
+
+    for (uint32_t i = 0; i < header.numDamages; ++i, bytes += sizeof(DomainDamage))
+    {
+        DomainDamage damage;
+        std::memcpy(&damage, bytes, sizeof(damage));
+        uint32_t index = world.stationaryIndex[damage.id];
+        if (index != NO_STATIONARY)
+        {
+            world.stationaryHp[index] -= damage.damage;
+        }
+    }
+    return true;
+}
+
+bool ExchangeDomain(Domain& domain, World& world)
+{
+    auto start = std::chrono::steady_clock::now();
+    SendMigrants(domain, world);
+    SendDamage(domain, world);
+    TransferMessages(domain);
+
+    bool valid = true;
+    for (uint32_t side = 0; side < 2; ++side)
+    {
+        if (domain.receive[side])
+        {
+            valid &= ReceiveMessage(domain, world, side);
+        }
+    }
+
+    // Both copies of a band circle now have the same hp, so the StepSimulation that kills one kills both. Removed circles
+    // are dropped from the band on both sides at once
+    for (uint32_t side = 0; side < 2; ++side)
+    {
+        std::vector<DomainBandCircle>& band = domain.band[side];
+        uint32_t numKept = 0;
+        for (const DomainBandCircle& circle : band)
+        {
+            uint32_t index = world.stationaryIndex[circle.id];
+            if (index == NO_STATIONARY)
+            {
+                continue;
+            }
+            int32_t hp = world.stationaryHp[index];
+            if (world.options.death && hp <= 0)
+            {
+                QueueStationaryRemove(world, circle.id);
+            }
+            band[numKept++] = { circle.id, hp };
+        }
+        band.resize(numKept);
+    }
+
+    ++domain.frame;
+    domain.stats.exchangeTime += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    return valid;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Results
+//---------------------------------------------------------------------------------------------------------------------
+
+void WriteResults(const World& world, float minX, float maxX, MovingResult* moving, StationaryResult* stationary)
+{
+    for (uint32_t i = 0; i < world.numMoving; ++i)
+    {
+        const Circle& circle = world.movingCircles[i];
+        if (circle.x >= minX && circle.x < maxX)
+        {
+            MovingResult& result = moving[world.movingIds[i]];
+            result.alive = 1;
+            result.hp = world.movingHp[i];
+            result.circle = circle;
+            result.velocity = world.movingVelocitys[i];
+        }
+    }
+
+    // Tombstones, and halo circles owned by a neighbour, are left to whoever writes them
+    for (uint32_t i = 0; i < world.numStationary; ++i)
+    {
+        const Circle& circle = world.stationaryCircles[i];
+        uint32_t id = world.stationaryIds[i];
+        if (world.stationaryIndex[id] == i && circle.x >= minX && circle.x < maxX)
+        {
+            stationary[id].alive = 1;
+            stationary[id].hp = world.stationaryHp[i];
+        }
+    }
+}
+
+void WriteDomainResults(const Domain& domain, const World& world, DomainShared& shared)
+{
+    WriteResults(world, domain.minX, domain.maxX, shared.moving, shared.stationary);
+    DomainStats& stats = shared.stats[domain.index];
+    stats = domain.stats;
+    stats.numMoving = world.numMoving;
+    stats.numStationary = world.numStationary;
+}
+
+uint64_t DigestResults(const MovingResult* moving, uint32_t numMovingIds, const StationaryResult* stationary, uint32_t numStationaryIds)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const void* data, std::size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    add(moving, numMovingIds * sizeof(MovingResult));
+    add(stationary, numStationaryIds * sizeof(StationaryResult));
+    return hash;
+}
+
+uint64_t DigestWorld(const World& world)
+{
+    uint32_t numMovingIds = world.options.circles / 2;
+    uint32_t numStationaryIds = static_cast<uint32_t>(world.stationaryIndex.size());
+    std::vector<MovingResult> moving(numMovingIds, MovingResult());
+    std::vector<StationaryResult> stationary(numStationaryIds, StationaryResult());
+    const float infinity = std::numeric_limits<float>::infinity();
+    WriteResults(world, -infinity, infinity, moving.data(), stationary.data());
+    return DigestResults(moving.data(), numMovingIds, stationary.data(), numStationaryIds);
+}
@@ -0,0 +1,155 @@
+// Domain.h: Splits the world into x-strips, each simulated by its own process, that trade border circles over shared memory
+#pragma once
+
+#include "Memory.h"
+#include "Simulation.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Domains
+//---------------------------------------------------------------------------------------------------------------------
+
+// Domain k of N owns the circles whose centres are in strip k of the generation bounds, the outer edges of the end strips
+// being at infinity. In one StepSimulation a moving circle can only touch stationary circles within the halo of where it
+// started, its furthest move plus two of the largest radius, so each domain also holds a read-only copy of the
+// stationary circles within a halo of its strip.
+// Stationary circles within a halo of a boundary, the band, can be hit from both sides. After every StepSimulation each
+// domain sends its neighbours the hp each band circle lost since the last exchange and the moving circles that left its
+// strip. Adding the neighbour's losses leaves both copies of a band circle with the hp a single process would have, and
+// as a stationary circle only dies at the start of the next StepSimulation, both copies die together. With a fixed
+// timestep a circle killed in one sub-step stops being hit in the next, which needs both sides' hits, so domains with
+// death need fixed-timestep 0.
+// Moving circles don't collide with each other here, as resolving the pairs is one sequential pass in x-order over the
+// whole world. So domains need moving collisions off, and the moving circles need no halo.
+// Stationary circle ids are their rank in the x-sorted order of all of them, so each domain sorts every stationary circle
+// to find its ids, and keeps only its share.
+// Impact ties are broken on x-order, so with the same options, seed and frames the domains end up with exactly what a single
+// process has
+
+//Most domains a world can be split into
+const uint32_t MAX_DOMAINS = 64;
+
+//Bytes of each ring, a frame's messages are streamed through so this only bounds how far a sender gets ahead
+const std::size_t DOMAIN_RING_SIZE = 1 << 20;
+
+// One direction of one boundary, a single producer single consumer byte ring. Both counters only grow, and each is on its
+// own cache line so the two processes don't fight over one. The DOMAIN_RING_SIZE bytes of data follow the counters
+struct DomainRing
+{
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head; //Bytes written, stored by the sender
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail; //Bytes read, stored by the receiver
+};
+
+//Final state of a moving circle, by id, as compared between runs. A dead circle is all zeros
+struct MovingResult
+{
+    uint32_t alive;
+    int32_t hp;
+    Circle circle;
+    CircleVelocity velocity;
+};
+
+//Final state of a stationary circle, by id. A removed circle is all zeros
+struct StationaryResult
+{
+    uint32_t alive;
+    int32_t hp;
+};
+
+//What one domain did, reported by the launcher
+struct DomainStats
+{
+    uint32_t numMoving;     //Owned at the end
+    uint32_t numStationary; //Held, halos included
+    uint64_t migrated;      //Moving circles sent to a neighbour
+    uint64_t damageSent;    //Band circle hp losses sent to a neighbour
+    uint64_t exchangeTime;  //Nanoseconds spent exchanging
+};
+
+// Memory shared by every domain process, mapped by the launcher before it forks them: the rings, then a stats block per
+// domain, then the result tables every domain writes its own circles into
+struct DomainShared
+{
+    void* memory = nullptr;
+    std::size_t size = 0;
+    uint32_t numDomains = 0;
+    uint8_t* rings = nullptr;
+    DomainStats* stats = nullptr;
+    MovingResult* moving = nullptr;
+    StationaryResult* stationary = nullptr;
+    uint32_t numMovingIds = 0;
+    uint32_t numStationaryIds = 0;
+};
+
+//A stationary circle either side of a boundary can hit, with the hp both sides last agreed on
+struct DomainBandCircle
+{
+    uint32_t id;
+    int32_t hp;
+};
+
+struct Domain
+{
+    uint32_t index = 0;
+    uint32_t numDomains = 1;
+    float minX = 0.0f; //Owned strip [minX, maxX)
+    float maxX = 0.0f;
+    float halo = 0.0f;
+    uint32_t frame = 0;
+
+    //Towards the lower and upper neighbour, null at an end
+    DomainRing* send[2] = {};
+    DomainRing* receive[2] = {};
+    std::vector<DomainBandCircle> band[2];
+
+    //Message bytes per direction, kept between frames so they are only allocated once
+    std::vector<uint8_t> outgoing[2];
+    std::vector<uint8_t> incoming[2];
+
+    DomainStats stats = {};
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Functions
+//---------------------------------------------------------------------------------------------------------------------
+
+//How far from a strip the domain holds stationary circles, for StepSimulation called with frameTime
+float DomainHalo(const SimulationOptions& options, float frameTime);
+
+//Turns off what domains can't do, moving collisions and the collision log, saying so for each it changes. Does nothing
+//for a single domain
+void ApplyDomainDefaults(SimulationOptions& options, uint32_t numDomains);
+
+//Returns false, after saying why, if the options can't be split into numDomains domains
+bool ValidateDomains(const SimulationOptions& options, float frameTime, uint32_t numDomains);
+
+//Maps the shared memory for numDomains domains of a world with these options, zeroed. Returns false, after saying why, if
+//it can't be had. Only supported where processes can be forked, it fails on Windows
+bool CreateDomainShared(DomainShared& shared, const SimulationOptions& options, uint32_t numDomains);
+void DestroyDomainShared(DomainShared& shared);
+
+//Sets up domain index of shared's domains, call in the domain's own process
+void StartDomain(Domain& domain, DomainShared& shared, uint32_t index, const SimulationOptions& options, float frameTime);
+
+//Generates the domain's share of the world GenerateWorld would make from the same options and seed, prepared to step.
+//Names are left empty, domains run without a collision log
+void GenerateDomainWorld(World& world, Domain& domain, const SimulationOptions& options, uint32_t seed);
+
+//Trades migrating moving circles and band hp losses with both neighbours, call after every StepSimulation. Waits for the
+//neighbours to reach the same frame. Returns false, after saying why, if a neighbour is out of step
+bool ExchangeDomain(Domain& domain, World& world);
+
+//Writes the domain's own circles and stats into shared
+void WriteDomainResults(const Domain& domain, const World& world, DomainShared& shared);
+
+//Writes the world's circles with centres in [minX, maxX) into tables indexed by id, sized for every id
+void WriteResults(const World& world, float minX, float maxX, MovingResult* moving, StationaryResult* stationary);
+
+//FNV-1a of the result tables, equal digests mean bit-identical results
+uint64_t DigestResults(const MovingResult* moving, uint32_t numMovingIds, const StationaryResult* stationary, uint32_t numStationaryIds);
+
+//Digest of a whole single-process world, to compare with the launcher's
+uint64_t DigestWorld(const World& world);
@@ -0,0 +1,680 @@
+// Headless.cpp: Runs the simulation without a visualiser and reports throughput
+
+#include "Domain.h"
+#include "Profile.h"
+#include "Query.h"
+#include "RenderSink.h"
+#include "Snapshot.h"
+#include "Trajectory.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+
+#if !defined(_WIN32)
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+// Command Line
+//---------------------------------------------------------------------------------------------------------------------
+
+struct HeadlessOptions
+{
+    uint32_t frames = 1000;
+    float timestep = 1.0f / 60.0f;
+    uint32_t threads = 0; //0 uses every hardware thread
+    uint32_t seed = 1;
+    uint32_t churn = 0; //Stationary circles replaced each frame
+    bool record = false; //Send frames to a recording sink rather than the null sink
+    std::string checkpoint; //Snapshot written after checkpointFrame frames, empty for none
+    uint32_t checkpointFrame = 0;
+    uint32_t queries = 0; //Circle, box and nearest queries of the stationary circles each frame, run while the step runs
+    uint32_t queryThreads = 1; //Threads answering them, the main thread included
+    uint32_t processes = 1; //Simulation processes, each owning an x-strip of the world
+    bool digest = false; //Print a digest of the final circles, to compare runs
+    SimulationOptions simulation;
+};
+
+static void PrintUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [options]\n"
+        << "  --frames N      Number of frames to simulate (default 1000)\n"
+        << "  --timestep S    Fixed frame time in seconds (default 1/60)\n"
+        << "  --threads N     Threads including the main thread, 0 for all hardware threads (default 0)\n"
+        << "  --seed N        World generation seed (default 1)\n"
+        << "  --churn N       Stationary circles removed and inserted each frame (default 0)\n"
+        << "  --sink null|record  Render sink each frame is sent to, record counts the circles sent (default null)\n"
+        << "  --checkpoint FILE  Write a snapshot of the world to FILE\n"
+        << "  --checkpoint-frame N  Frames run before the checkpoint is written (default 0)\n"
+        << "  --queries N     Stationary circle queries of each kind run each frame alongside the step (default 0)\n"
+        << "  --query-threads N  Threads answering them, including the main thread (default 1)\n"
+        << "  --processes N   Split the world into N x-strips, each simulated by its own process,\n"
+        << "                  with moving-collisions and log turned off (default 1)\n"
+        << "  --digest on|off Print a digest of the final circles, equal for runs with equal results (default off)\n"
+        << "  --config FILE   Read simulation options from FILE, one \"name = value\" per line\n"
+        << "Simulation options, given as --name value:\n";
+    PrintOptions(std::cout);
+}
+
+static bool ParseUnsigned(const char* text, uint32_t& value)
+{
+    char* end;
+    unsigned long parsed = std::strtoul(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || text[0] == '-')
+    {
+        return false;
+    }
+    value = static_cast<uint32_t>(parsed);
+    return true;
+}
+
+static bool ParseFloat(const char* text, float& value)
+{
+    char* end;
+    value = std::strtof(text, &end);
+    return *text != '\0' && *end == '\0';
+}
+
+//Returns false, after saying why, if the command line can't be used
+static bool ParseOptions(int argc, char** argv, HeadlessOptions& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h")
+        {
+            return false;
+        }
+        if (arg.compare(0, 2, "--") != 0)
+        {
+            std::cout << "Unknown option " << arg << std::endl;
+            return false;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cout << "Missing value for " << arg << std::endl;
+            return false;
+        }
+
+        const char* value = argv[++i];
+        bool valid;
+        if (arg == "--frames")         valid = ParseUnsigned(value, options.frames);
+        else if (arg == "--timestep")  valid = ParseFloat(value, options.timestep) && options.timestep > 0.0f;
+        else if (arg == "--threads")   valid = ParseUnsigned(value, options.threads) && options.threads <= MAX_THREADS;
+        else if (arg == "--seed")      valid = ParseUnsigned(value, options.seed);
+        else if (arg == "--churn")     valid = ParseUnsigned(value, options.churn);
+        else if (arg == "--checkpoint")
+        {
+            options.checkpoint = value;
+            valid = !options.checkpoint.empty();
+        }
+        else if (arg == "--checkpoint-frame")  valid = ParseUnsigned(value, options.checkpointFrame);
+        else if (arg == "--queries")   valid = ParseUnsigned(value, options.queries);
+        else if (arg == "--query-threads")  valid = ParseUnsigned(value, options.queryThreads) && options.queryThreads >= 1 && options.queryThreads <= MAX_THREADS;
+        else if (arg == "--processes")  valid = ParseUnsigned(value, options.processes);
+        else if (arg == "--digest")
+        {
+            valid = true;
+            if (std::string(value) == "on")         options.digest = true;
+            else if (std::string(value) == "off")   options.digest = false;
+            else valid = false;
+        }
+        else if (arg == "--sink")
+        {
+            valid = true;
+            if (std::string(value) == "null")         options.record = false;
+            else if (std::string(value) == "record")  options.record = true;
+            else valid = false;
+        }
+        else if (arg == "--config")
+        {
+            if (!LoadOptions(options.simulation, value))
+            {
+                return false;
+            }
+            valid = true;
+        }
+        else
+        {
+            OptionError error = SetOption(options.simulation, arg.substr(2), value);
+            if (error == OptionError::UnknownName)
+            {
+                std::cout << "Unknown option " << arg << std::endl;
+                return false;
+            }
+            valid = error == OptionError::None;
+        }
+
+        if (!valid)
+        {
+            std::cout << "Invalid value for " << arg << ": " << value << std::endl;
+            return false;
+        }
+    }
+    if (options.processes > 1 && (options.churn > 0 || !options.checkpoint.empty() || options.record || options.queries > 0))
+    {
+        std::cout << "Processes can't churn, checkpoint, record or query" << std::endl;
+        return false;
+    }
+    ApplyDomainDefaults(options.simulation, options.processes);
+    return ValidateOptions(options.simulation) && ValidateDomains(options.simulation, options.timestep, options.processes);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Stationary Churn
+//---------------------------------------------------------------------------------------------------------------------
+
+//Queues the removal of count random stationary circles and the insert of count new ones. Everything is keyed by the id
+//the new circle gets, which snapshots keep, so a run resumed from a checkpoint churns the same circles
+static void ChurnStationary(World& world, uint32_t count, uint32_t seed)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t id = static_cast<uint32_t>(world.stationaryIndex.size());
+
+        // Picked from the stationary arrays rather than from every id ever given out, so most picks are still there
+        if (world.numStationary > 0)
+        {
+            uint32_t pick = Philox(seed, RANDOM_CHURN, id, RANDOM_CHOICE).values[0];
+            QueueStationaryRemove(world, world.stationaryIds[RandomRange(pick, 0, world.numStationary - 1)]);
+        }
+
+        QueueStationaryInsert(world, RandomCircle(world.options, seed, RANDOM_CHURN, id), RandomName(seed, RANDOM_CHURN, id), RandomColour(seed, RANDOM_CHURN, id));
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Queries
+//---------------------------------------------------------------------------------------------------------------------
+
+//Stationary circles each nearest query asks for
+const uint32_t NEAREST_QUERY_COUNT = 8;
+
+//A frame's query batches, kept between frames
+struct QueryLoad
+{
+    std::vector<CircleQuery> circles;
+    std::vector<BoxQuery> boxes;
+    std::vector<PointQuery> points;
+    QueryResults results;
+    uint64_t found = 0;
+};
+
+//Asks count circle, box and nearest queries around random points, keyed by frame so every run asks the same ones. Only
+//reads the stationary circles, so it can run while the step is in flight
+static void RunQueryBatches(JobScheduler& jobs, const World& world, QueryLoad& load, uint32_t count, uint32_t seed, uint32_t frame)
+{
+    load.circles.resize(count);
+    load.boxes.resize(count);
+    load.points.resize(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Circle circle = RandomCircle(world.options, seed, RANDOM_QUERY, frame * count + i);
+        float size = circle.rad * 4.0f;
+        load.circles[i] = { circle.x, circle.y, size };
+        load.boxes[i] = { circle.x - size, circle.y - size, circle.x + size, circle.y + size };
+        load.points[i] = { circle.x, circle.y };
+    }
+
+    StationaryView view = ViewStationary(world);
+    QueryCircles(jobs, view, load.circles.data(), count, load.results);
+    load.found += load.results.ids.size();
+    QueryBoxes(jobs, view, load.boxes.data(), count, load.results);
+    load.found += load.results.ids.size();
+    QueryNearest(jobs, view, load.points.data(), count, NEAREST_QUERY_COUNT, load.results);
+    load.found += load.results.ids.size();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Replay
+//---------------------------------------------------------------------------------------------------------------------
+
+//Sends every frame of a recorded trajectory to the sink in place of simulating, and reports how long decoding took
+static int RunReplay(const HeadlessOptions& options)
+{
+    TrajectoryReader reader;
+    if (!OpenTrajectory(reader, options.simulation.replay.c_str()))
+    {
+        return 1;
+    }
+
+    RenderRecording recording;
+    RenderSink sink = options.record ? RecordingRenderSink(recording) : NullRenderSink();
+    FrameState frame;
+    uint32_t numFrames = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (ReadTrajectoryFrame(reader, frame))
+    {
+        SubmitFrame(sink, frame);
+        ++numFrames;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    bool complete = numFrames == reader.numFrames;
+    CloseTrajectory(reader);
+
+    std::cout << "Frames replayed: " << numFrames << std::endl;
+    if (options.record && recording.frames > 0)
+    {
+        std::cout << "Circles sent to the sink per frame: " << recording.moves.size() / recording.frames << std::endl;
+    }
+    std::cout << "Time taken: " << elapsed.count() << " microseconds" << std::endl;
+    if (numFrames > 0)
+    {
+        std::cout << "Average frame decode time: " << elapsed.count() / numFrames << " microseconds" << std::endl;
+    }
+    return complete ? 0 : 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Domains
+//---------------------------------------------------------------------------------------------------------------------
+
+#if !defined(_WIN32)
+//Body of one domain's process: generates its strip, steps and exchanges every frame, then writes its results
+static int RunDomain(const HeadlessOptions& options, DomainShared& shared, uint32_t index, uint32_t numThreads)
+{
+    StartScheduler(numThreads - 1);
+    if (options.simulation.hugePages)
+    {
+        EnableHugePages(true);
+    }
+
+    Domain domain;
+    StartDomain(domain, shared, index, options.simulation, options.timestep);
+    World world;
+    GenerateDomainWorld(world, domain, options.simulation, options.seed);
+
+    bool valid = true;
+    for (uint32_t frame = 0; frame < options.frames && valid; ++frame)
+    {
+        StepSimulation(world, options.timestep);
+        valid = ExchangeDomain(domain, world);
+    }
+    if (valid)
+    {
+        WriteDomainResults(domain, world, shared);
+    }
+    StopScheduler();
+    std::cout.flush();
+    return valid ? 0 : 1;
+}
+#endif
+
+//Forks a process per domain, splitting the threads between them, and reports the merged results once all have finished
+static int RunDomains(const HeadlessOptions& options, uint32_t numThreads)
+{
+#if defined(_WIN32)
+    std::cout << "--processes needs fork, which Windows doesn't have" << std::endl;
+    return 1;
+#else
+    DomainShared shared;
+    if (!CreateDomainShared(shared, options.simulation, options.processes))
+    {
+        return 1;
+    }
+
+    narrowPhase = SelectNarrowPhaseKernel(options.simulation.maxSimd);
+    uint32_t threadsPerDomain = std::max(numThreads / options.processes, 1u);
+    std::cout << "Narrow phase: " << narrowPhase.name << ", processes: " << options.processes << ", threads each: " << threadsPerDomain << std::endl;
+
+    // Anything still buffered would be written again by every child
+    std::cout.flush();
+    std::fflush(stdout);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<pid_t> children;
+    for (uint32_t index = 0; index < options.processes; ++index)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            // Skip the parent's exit handlers, the child only shares its memory
+            _exit(RunDomain(options, shared, index, threadsPerDomain));
+        }
+        if (pid < 0)
+        {
+            std::cout << "Could not start process " << index << std::endl;
+            break;
+        }
+        children.push_back(pid);
+    }
+
+    // A domain that fails leaves its neighbours waiting on it forever, so the rest are stopped
+    bool success = children.size() == options.processes;
+    bool stopped = false;
+    for (size_t remaining = children.size(); remaining > 0; --remaining)
+    {
+        if (!success && !stopped)
+        {
+            for (pid_t child : children)
+            {
+                kill(child, SIGTERM);
+            }
+            stopped = true;
+        }
+        int status;
+        if (wait(&status) < 0)
+        {
+            break;
+        }
+        success &= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    if (!success)
+    {
+        std::cout << "A simulation process failed" << std::endl;
+        DestroyDomainShared(shared);
+        return 1;
+    }
+
+    for (uint32_t index = 0; index < options.processes; ++index)
+    {
+        const DomainStats& stats = shared.stats[index];
+        std::cout << "Process " << index << ": " << stats.numMoving << " moving circles, " << stats.numStationary << " stationary held, "
+            << stats.migrated << " migrated, " << stats.damageSent << " band hp losses sent";
+        if (options.frames > 0)
+        {
+            std::cout << ", average exchange time " << stats.exchangeTime / 1000 / options.frames << " microseconds";
+        }
+        std::cout << std::endl;
+    }
+    if (options.simulation.death)
+    {
+        uint32_t alive = 0;
+        for (uint32_t id = 0; id < shared.numMovingIds; ++id)
+        {
+            alive += shared.moving[id].alive;
+        }
+        std::cout << "Moving circles alive: " << alive << std::endl;
+    }
+    if (options.digest)
+    {
+        std::cout << "Digest: " << std::hex << DigestResults(shared.moving, shared.numMovingIds, shared.stationary, shared.numStationaryIds) << std::dec << std::endl;
+    }
+    std::cout << "Time taken: " << elapsed.count() << " microseconds" << std::endl;
+    if (elapsed.count() > 0)
+    {
+        double throughput = static_cast<double>(options.simulation.circles) * options.frames / (elapsed.count() / 1000000.0);
+        std::cout << "Throughput: " << static_cast<uint64_t>(throughput) << " circle-frames/sec" << std::endl;
+    }
+    DestroyDomainShared(shared);
+    return 0;
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Stats
+//---------------------------------------------------------------------------------------------------------------------
+
+//How evenly a partitioned loop's work was dealt, then each thread's time in it, which stealing evens out further
+static void PrintPartitionStats(const char* name, const ChunkPartition& partition, uint32_t numThreads)
+{
+    if (partition.runs == 0)
+    {
+        return;
+    }
+
+    std::ios::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << name << " imbalance, costliest thread over mean: " << partition.dealtImbalance / partition.runs
+        << " as dealt, " << partition.evenImbalance / partition.runs << " dealt evenly, dealt by cost in "
+        << 100.0 * partition.costRuns / partition.runs << "% of runs" << std::endl;
+    if (partition.scoredRuns > 0)
+    {
+        std::cout << "  Had every scored run been dealt by cost: " << partition.scoredCostImbalance / partition.scoredRuns
+            << " by cost, " << partition.scoredEvenImbalance / partition.scoredRuns << " evenly" << std::endl;
+    }
+
+    uint64_t totalBusy = 0;
+    for (uint32_t i = 0; i < numThreads; ++i)
+    {
+        totalBusy += partition.threads[i].busy;
+    }
+    for (uint32_t i = 0; i < numThreads; ++i)
+    {
+        double share = totalBusy > 0 ? static_cast<double>(partition.threads[i].busy) * numThreads / totalBusy : 1.0;
+        std::cout << "  Thread " << i << ": " << partition.threads[i].busy / 1000 / partition.runs << " microseconds per step, "
+            << share << " of mean, " << static_cast<double>(partition.threads[i].stolen) / partition.runs << " chunks stolen per step" << std::endl;
+    }
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+//How long handing each ParallelFor to the workers and waiting for the last of them took
+static void PrintSchedulerStats(const char* name, const JobScheduler& jobs)
+{
+    SchedulerStats stats = GetSchedulerStats(jobs);
+    if (stats.runs == 0 || stats.wakes == 0)
+    {
+        return;
+    }
+
+    std::ios::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << name << " ParallelFors: " << stats.runs << ", wake-up latency " << static_cast<double>(stats.wakeTime) / 1000 / stats.wakes
+        << " microseconds, " << 100.0 * stats.parks / stats.wakes << "% of wake-ups from parked, finish wait "
+        << static_cast<double>(stats.finishWait) / 1000 / stats.runs << " microseconds" << std::endl;
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Main
+//---------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    HeadlessOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (!options.simulation.replay.empty())
+    {
+        return RunReplay(options);
+    }
+
+    // Start worker threads
+    uint32_t numThreads = options.threads;
+    if (numThreads == 0)  numThreads = std::thread::hardware_concurrency(); // 0 means no hint given
+    if (numThreads == 0)  numThreads = 8;
+    if (numThreads > MAX_THREADS)  numThreads = MAX_THREADS;
+    if (options.processes > 1)
+    {
+        return RunDomains(options, numThreads);
+    }
+    bool profile = !options.simulation.profileTrace.empty() || !options.simulation.profileSummary.empty();
+    if (profile)
+    {
+        // Before the workers start, so they see it enabled
+        StartProfiler(PROFILE_EVENTS_PER_THREAD);
+        ProfileThreadName("Main");
+    }
+    scheduler.pinThreads = options.simulation.pinThreads;
+    StartScheduler(numThreads - 1); // Less one because this main thread is already running
+    if (options.simulation.hugePages)
+    {
+        EnableHugePages(true);
+    }
+
+    World world;
+    auto loadStart = std::chrono::steady_clock::now();
+    if (!options.simulation.snapshot.empty())
+    {
+        if (!LoadSnapshot(world, options.simulation, options.simulation.snapshot.c_str()))
+        {
+            StopScheduler();
+            return 1;
+        }
+    }
+    else
+    {
+        GenerateWorld(world, options.simulation, options.seed);
+        PrepareWorld(world);
+    }
+    auto loadTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - loadStart);
+    std::cout << "World ready in " << loadTime.count() << " microseconds" << std::endl;
+
+    TrajectoryRecorder recorder;
+    bool recordTrajectory = !options.simulation.trajectory.empty();
+    if (recordTrajectory && !StartTrajectoryRecorder(recorder, options.simulation.trajectory.c_str(), world))
+    {
+        StopScheduler();
+        return 1;
+    }
+
+    narrowPhase = SelectNarrowPhaseKernel(options.simulation.maxSimd);
+    std::cout << "Narrow phase: " << narrowPhase.name << ", threads: " << numThreads << std::endl;
+
+    StartCollisionLog(options.simulation.collisionLog, options.simulation.collisionLogFile.c_str(), numThreads, world);
+
+    // Queries get their own threads, with this thread as their thread 0, as the step has the scheduler's
+    JobScheduler queryScheduler;
+    queryScheduler.threadName = "Query worker";
+    QueryLoad queryLoad;
+    if (options.queries > 0)
+    {
+        StartScheduler(queryScheduler, options.queryThreads - 1);
+    }
+
+    // Nothing is drawn, but the step still runs through the pipeline so both modes can be compared
+    SimulationPipeline pipeline;
+    StartPipeline(pipeline, world, !options.simulation.pipeline);
+    RenderRecording recording;
+    RenderSink sink = options.record ? RecordingRenderSink(recording) : NullRenderSink();
+
+    auto start = std::chrono::steady_clock::now();
+    long long totalTicktime = 0;
+    long long totalUpdateTime = 0;
+    long long totalRecordTime = 0;
+    long long totalQueryTime = 0;
+    for (uint32_t frame = 0; frame < options.frames; ++frame)
+    {
+        auto tickStart = std::chrono::steady_clock::now();
+        FinishStep(pipeline);
+        totalTicktime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tickStart).count();
+
+        if (!options.checkpoint.empty() && frame == options.checkpointFrame)
+        {
+            SaveSnapshot(world, options.checkpoint.c_str());
+        }
+
+        if (options.churn > 0)
+        {
+            // Applied here rather than inside StepSimulation so the cost can be reported on its own
+            auto updateStart = std::chrono::steady_clock::now();
+            ChurnStationary(world, options.churn, options.seed);
+            ApplyStationaryUpdates(world);
+            totalUpdateTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - updateStart).count();
+        }
+
+        tickStart = std::chrono::steady_clock::now();
+        LaunchStep(pipeline, options.timestep);
+        totalTicktime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tickStart).count();
+
+        if (options.queries > 0)
+        {
+            auto queryStart = std::chrono::steady_clock::now();
+            RunQueryBatches(queryScheduler, world, queryLoad, options.queries, options.seed, frame);
+            totalQueryTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - queryStart).count();
+        }
+
+        SubmitFrame(sink, FrontFrame(pipeline));
+
+        if (recordTrajectory)
+        {
+            auto recordStart = std::chrono::steady_clock::now();
+            RecordTrajectoryFrame(recorder, FrontFrame(pipeline));
+            totalRecordTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - recordStart).count();
+        }
+    }
+    auto tickStart = std::chrono::steady_clock::now();
+    StopPipeline(pipeline);
+    totalTicktime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tickStart).count();
+    if (!options.checkpoint.empty() && options.checkpointFrame == options.frames)
+    {
+        SaveSnapshot(world, options.checkpoint.c_str());
+    }
+    auto end = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+
+    if (recordTrajectory)
+    {
+        StopTrajectoryRecorder(recorder);
+    }
+    uint64_t dropped = StopCollisionLog();
+    if (options.queries > 0)
+    {
+        StopScheduler(queryScheduler);
+    }
+    StopScheduler();
+
+    if (!options.simulation.profileTrace.empty())
+    {
+        WriteProfileTrace(options.simulation.profileTrace.c_str());
+    }
+    if (!options.simulation.profileSummary.empty())
+    {
+        WriteProfileSummary(options.simulation.profileSummary.c_str());
+    }
+
+    if (dropped > 0)
+    {
+        std::cout << "Collision events dropped: " << dropped << std::endl;
+    }
+    if (world.options.death)
+    {
+        std::cout << "Moving circles alive: " << world.numMoving << std::endl;
+    }
+    if (options.digest)
+    {
+        std::cout << "Digest: " << std::hex << DigestWorld(world) << std::dec << std::endl;
+    }
+    if (options.record && recording.frames > 0)
+    {
+        std::cout << "Circles sent to the sink per frame: " << recording.moves.size() / recording.frames << std::endl;
+    }
+    std::cout << "Time taken: " << elapsed.count() << " microseconds" << std::endl;
+    if (options.frames > 0)
+    {
+        // Time this thread spent waiting on the simulation, which pipelined is whatever it could not overlap
+        std::cout << "Average tick time: " << totalTicktime / options.frames << " microseconds" << std::endl;
+        if (options.churn > 0)
+        {
+            std::cout << "Average stationary update time: " << totalUpdateTime / options.frames << " microseconds" << std::endl;
+        }
+        if (recordTrajectory)
+        {
+            std::cout << "Average trajectory record time: " << totalRecordTime / options.frames << " microseconds" << std::endl;
+        }
+        if (options.queries > 0)
+        {
+            // Alongside the step when pipelined, so this is time the main thread spent rather than time added to the frame
+            std::cout << "Average query time: " << totalQueryTime / options.frames << " microseconds for " << options.queries * 3
+                << " queries, " << queryLoad.found / options.frames << " circles found per frame" << std::endl;
+        }
+    }
+    PrintPartitionStats("Collision", world.collidePartition, numThreads);
+    PrintPartitionStats("Moving pairs", world.pairsPartition, numThreads);
+    PrintSchedulerStats("Scheduler", scheduler);
+    if (options.queries > 0)
+    {
+        PrintSchedulerStats("Query scheduler", queryScheduler);
+    }
+    if (elapsed.count() > 0)
+    {
+        // Every circle, moving and stationary, counts once per frame
+        double throughput = static_cast<double>(world.options.circles) * options.frames / (elapsed.count() / 1000000.0);
+        std::cout << "Throughput: " << static_cast<uint64_t>(throughput) << " circle-frames/sec" << std::endl;
+    }
+    return 0;
+}
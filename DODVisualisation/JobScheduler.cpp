@@ -0,0 +1,442 @@
+// JobScheduler.cpp: Work-stealing ParallelFor over a pool of worker threads
+
+#include "JobScheduler.h"
+#include "Profile.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define DOD_PAUSE() _mm_pause()
+#else
+#define DOD_PAUSE()
+#endif
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+JobScheduler scheduler;
+
+static uint64_t ChunkTime()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+//Takes a chunk from the front of a thread's own run, counting compare-exchanges that lose a race in retries
+static bool PopChunk(ChunkQueue& queue, uint32_t& chunk, uint32_t& retries)
+{
+    uint64_t chunks = queue.chunks.load();
+    while (true)
+    {
+        uint32_t front = static_cast<uint32_t>(chunks);
+        uint32_t back = static_cast<uint32_t>(chunks >> 32);
+        if (front >= back)
+        {
+            return false;
+        }
+        if (queue.chunks.compare_exchange_weak(chunks, (static_cast<uint64_t>(back) << 32) | (front + 1)))
+        {
+            chunk = front;
+            return true;
+        }
+        ++retries;
+    }
+}
+
+//Takes a chunk from the back of another thread's run
+static bool StealChunk(ChunkQueue& queue, uint32_t& chunk, uint32_t& retries)
+{
+    uint64_t chunks = queue.chunks.load();
+    while (true)
+    {
+        uint32_t front = static_cast<uint32_t>(chunks);
+        uint32_t back = static_cast<uint32_t>(chunks >> 32);
+        if (front >= back)
+        {
+            return false;
+        }
+        if (queue.chunks.compare_exchange_weak(chunks, (static_cast<uint64_t>(back - 1) << 32) | front))
+        {
+            chunk = back - 1;
+            return true;
+        }
+        ++retries;
+    }
+}
+
+//Runs chunks of the current ParallelFor until there are none left to take or steal
+static void RunChunks(JobScheduler& scheduler, uint32_t thread)
+{
+    uint32_t numThreads = scheduler.numWorkers + 1;
+    ChunkPartition* partition = scheduler.partition;
+    uint32_t chunk;
+    uint32_t retries = 0;
+    uint32_t numStolen = 0;
+    uint64_t busy = 0;
+    while (true)
+    {
+        if (!PopChunk(scheduler.queues[thread], chunk, retries))
+        {
+            bool stolen = false;
+            for (uint32_t i = 1; i < numThreads && !stolen; ++i)
+            {
+                stolen = StealChunk(scheduler.queues[(thread + i) % numThreads], chunk, retries);
+            }
+            if (!stolen)
+            {
+                PROFILE_COUNT(PROFILE_CHUNKS_STOLEN, numStolen);
+                PROFILE_COUNT(PROFILE_CAS_RETRIES, retries);
+                if (partition)
+                {
+                    partition->threads[thread].busy += busy;
+                    partition->threads[thread].stolen += numStolen;
+                }
+                return;
+            }
+            ++numStolen;
+        }
+
+        uint32_t chunkBegin = scheduler.begin + chunk * scheduler.chunkSize;
+        uint32_t chunkEnd = std::min(chunkBegin + scheduler.chunkSize, scheduler.end);
+        if (partition)
+        {
+            // Every chunk is run once, so its cost slot is only ever written by this thread
+            uint64_t start = ChunkTime();
+            scheduler.fn(scheduler.context, chunkBegin, chunkEnd, thread);
+            uint64_t cost = ChunkTime() - start;
+            partition->costs[chunk] = cost;
+            busy += cost;
+        }
+        else
+        {
+            scheduler.fn(scheduler.context, chunkBegin, chunkEnd, thread);
+        }
+    }
+}
+
+//Polls done until it holds or spinNanoseconds have passed, returning whether it held
+template <typename Done>
+static bool SpinUntil(Done&& done, uint64_t spinNanoseconds)
+{
+    uint64_t start = ChunkTime();
+    for (uint32_t i = 1; !done(); ++i)
+    {
+        // Reading the clock costs more than a pause, so only every so often
+        if ((i & 63) == 0 && ChunkTime() - start >= spinNanoseconds)
+        {
+            return false;
+        }
+        DOD_PAUSE();
+    }
+    return true;
+}
+
+//Pins a thread to one core, returning false where the OS doesn't allow it
+static bool PinThread(std::thread& thread, uint32_t core)
+{
+#if defined(_WIN32)
+    return core < 64 && SetThreadAffinityMask(thread.native_handle(), static_cast<DWORD_PTR>(1) << core) != 0;
+#elif defined(__linux__)
+    cpu_set_t cores;
+    CPU_ZERO(&cores);
+    CPU_SET(core, &cores);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(cores), &cores) == 0;
+#else
+    return false;
+#endif
+}
+
+//*********************************************************
+// Worker threads run this method
+// The worker waits for a ParallelFor to be started, runs chunks until there are none left, then signals it is done.
+// It then returns to waiting. These threads are created at start-up time and joined at shutdown,
+// because creating threads at runtime is too slow for this kind of game usage
+static void SchedulerThread(JobScheduler* jobs, uint32_t thread)
+{
+    JobScheduler& scheduler = *jobs;
+    SchedulerThreadState& state = scheduler.threads[thread];
+    PROFILE_ONLY(ProfileThreadName(scheduler.threadName);)
+    while (true)
+    {
+        {
+            PROFILE_SCOPE(PROFILE_WAIT);
+            auto ready = [&]() { return scheduler.generation.load() != state.seen; };
+            if (!SpinUntil(ready, scheduler.spinNanoseconds))
+            {
+                // Counted as parked before the last test, under the lock, so a ParallelFor handed out after it notifies
+                std::unique_lock<std::mutex> l(scheduler.lock);
+                scheduler.parkedWorkers.fetch_add(1);
+                scheduler.workReady.wait(l, ready); // The test is required because there is the possibility of "spurious
+                // wakeups": a false signal
+                scheduler.parkedWorkers.fetch_sub(1);
+                ++state.parks;
+            }
+            if (scheduler.stopping.load())
+            {
+                return;
+            }
+            state.seen = scheduler.generation.load();
+            state.wakeTime += ChunkTime() - scheduler.launchTime;
+            ++state.runs;
+        }
+
+        RunChunks(scheduler, thread);
+
+        // The last worker out wakes the calling thread if it parked
+        if (scheduler.activeWorkers.fetch_sub(1) == 1 && scheduler.callerParked.load())
+        {
+            std::unique_lock<std::mutex> l(scheduler.lock);
+            scheduler.workDone.notify_one();
+        }
+    }
+}
+
+void StartScheduler(JobScheduler& scheduler, uint32_t numWorkers)
+{
+    uint32_t numCores = std::thread::hardware_concurrency();
+    scheduler.numWorkers = numWorkers;
+    scheduler.stopping.store(false);
+    scheduler.spinNanoseconds = numCores > numWorkers ? SCHEDULER_SPIN_NANOSECONDS : 0;
+    for (uint32_t i = 0; i < MAX_THREADS; ++i)
+    {
+        scheduler.threads[i] = SchedulerThreadState();
+        scheduler.threads[i].seen = scheduler.generation.load();
+    }
+
+    bool pinned = true;
+    for (uint32_t i = 0; i < numWorkers; ++i)
+    {
+        scheduler.workers[i] = std::thread(&SchedulerThread, &scheduler, i + 1);
+        if (scheduler.pinThreads && numCores > 0)
+        {
+            pinned = PinThread(scheduler.workers[i], (i + 1) % numCores) && pinned;
+        }
+    }
+    if (!pinned)
+    {
+        std::cout << "Worker threads could not be pinned to cores, leaving them to the OS" << std::endl;
+    }
+}
+
+void StopScheduler(JobScheduler& scheduler)
+{
+    // A generation like any other wakes the workers, spinning or parked, to find they are stopping
+    scheduler.stopping.store(true);
+    scheduler.generation.fetch_add(1);
+    {
+        std::unique_lock<std::mutex> l(scheduler.lock);
+        scheduler.workReady.notify_all();
+    }
+    for (uint32_t i = 0; i < scheduler.numWorkers; ++i)
+    {
+        scheduler.workers[i].join();
+    }
+    scheduler.numWorkers = 0;
+}
+
+SchedulerStats GetSchedulerStats(const JobScheduler& scheduler)
+{
+    SchedulerStats stats;
+    stats.runs = scheduler.threads[0].runs;
+    stats.finishWait = scheduler.threads[0].waitTime;
+    for (uint32_t i = 1; i < MAX_THREADS; ++i)
+    {
+        stats.wakes += scheduler.threads[i].runs;
+        stats.parks += scheduler.threads[i].parks;
+        stats.wakeTime += scheduler.threads[i].wakeTime;
+    }
+    return stats;
+}
+
+//The cost of the costliest run over the mean, for runs starting at bounds
+static double Imbalance(const std::vector<uint64_t>& costs, const uint32_t* bounds, uint32_t numThreads, uint64_t total)
+{
+    uint64_t costliest = 0;
+    for (uint32_t i = 0; i < numThreads; ++i)
+    {
+        uint64_t cost = 0;
+        for (uint32_t chunk = bounds[i]; chunk < bounds[i + 1]; ++chunk)
+        {
+            cost += costs[chunk];
+        }
+        costliest = std::max(costliest, cost);
+    }
+    return total > 0 ? static_cast<double>(costliest) * numThreads / total : 1.0;
+}
+
+//Bounds splitting numChunks evenly by count
+static void EvenBounds(uint32_t* bounds, uint32_t numChunks, uint32_t numThreads)
+{
+    for (uint32_t i = 0; i <= numThreads; ++i)
+    {
+        bounds[i] = static_cast<uint32_t>(static_cast<uint64_t>(numChunks) * i / numThreads);
+    }
+}
+
+//Bounds where the prefix sum of costs reaches each thread's share of total
+static void CostBounds(uint32_t* bounds, const std::vector<uint64_t>& costs, uint64_t total, uint32_t numChunks, uint32_t numThreads)
+{
+    uint64_t sum = 0;
+    uint32_t chunk = 0;
+    bounds[0] = 0;
+    for (uint32_t i = 1; i < numThreads; ++i)
+    {
+        uint64_t share = total * i / numThreads;
+        while (chunk < numChunks && sum + costs[chunk] / 2 < share) // A chunk goes to whichever side holds more of it
+        {
+            sum += costs[chunk++];
+        }
+        bounds[i] = chunk;
+    }
+    bounds[numThreads] = numChunks;
+}
+
+//Scores the run just finished and the deal the averages gave against an even one, takes the run's costs into the
+//averages, then picks the next run's bounds
+static void UpdatePartition(ChunkPartition& partition, const uint32_t* dealt, bool dealtByCost, uint32_t numChunks, uint32_t numThreads)
+{
+    const std::vector<uint64_t>& costs = partition.costs;
+    uint64_t total = 0;
+    for (uint32_t chunk = 0; chunk < numChunks; ++chunk)
+    {
+        total += costs[chunk];
+    }
+
+    uint32_t even[MAX_THREADS + 1];
+    EvenBounds(even, numChunks, numThreads);
+    double evenImbalance = Imbalance(costs, even, numThreads, total);
+    ++partition.runs;
+    partition.costRuns += dealtByCost ? 1 : 0;
+    partition.dealtImbalance += Imbalance(costs, dealt, numThreads, total);
+    partition.evenImbalance += evenImbalance;
+
+    // The cost bounds were worked out before this run, so scoring them on its costs is a fair test of how well they predict
+    if (partition.numChunks == numChunks && partition.numThreads == numThreads)
+    {
+        double costImbalance = Imbalance(costs, partition.costBounds, numThreads, total);
+        ++partition.scoredRuns;
+        partition.scoredCostImbalance += costImbalance;
+        partition.scoredEvenImbalance += evenImbalance;
+        if (partition.scored)
+        {
+            partition.costScore += (costImbalance - partition.costScore) / PARTITION_SMOOTHING;
+            partition.evenScore += (evenImbalance - partition.evenScore) / PARTITION_SMOOTHING;
+        }
+        else
+        {
+            partition.costScore = costImbalance;
+            partition.evenScore = evenImbalance;
+            partition.scored = true;
+        }
+    }
+
+    // A run of another shape starts the averages again from its own costs
+    std::vector<uint64_t>& averages = partition.averages;
+    uint64_t averageTotal = 0;
+    if (averages.size() != numChunks)
+    {
+        averages.assign(costs.begin(), costs.begin() + numChunks);
+        averageTotal = total;
+    }
+    else
+    {
+        uint64_t meanCost = total / numChunks;
+        for (uint32_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            uint64_t cost = std::min(costs[chunk], std::max(averages[chunk], meanCost) * PARTITION_OUTLIER);
+            averages[chunk] = averages[chunk] - averages[chunk] / PARTITION_SMOOTHING + cost / PARTITION_SMOOTHING;
+            averageTotal += averages[chunk];
+        }
+    }
+
+    CostBounds(partition.costBounds, averages, averageTotal, numChunks, numThreads);
+    partition.dealByCost = partition.scored && partition.costScore < partition.evenScore;
+    const uint32_t* next = partition.dealByCost ? partition.costBounds : even;
+    std::copy(next, next + numThreads + 1, partition.bounds);
+    partition.numChunks = numChunks;
+    partition.numThreads = numThreads;
+}
+
+//Runs fn over [begin, end) in chunks on every thread and returns once all chunks are done
+void RunParallelFor(JobScheduler& scheduler, uint32_t begin, uint32_t end, uint32_t chunkSize, ChunkFn fn, void* context, ChunkPartition* partition)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    uint32_t numThreads = scheduler.numWorkers + 1;
+    uint32_t numChunks = static_cast<uint32_t>((static_cast<uint64_t>(end) - begin + chunkSize - 1) / chunkSize);
+
+    // Dealt as the last run picked if it had the same shape, otherwise evenly
+    uint32_t bounds[MAX_THREADS + 1];
+    bool dealtByCost = false;
+    if (partition && partition->numChunks == numChunks && partition->numThreads == numThreads)
+    {
+        std::copy(partition->bounds, partition->bounds + numThreads + 1, bounds);
+        dealtByCost = partition->dealByCost;
+    }
+    else
+    {
+        EvenBounds(bounds, numChunks, numThreads);
+    }
+    if (partition)
+    {
+        partition->costs.resize(numChunks);
+    }
+
+    scheduler.fn = fn;
+    scheduler.context = context;
+    scheduler.begin = begin;
+    scheduler.end = end;
+    scheduler.chunkSize = chunkSize;
+    scheduler.partition = partition;
+    for (uint32_t i = 0; i < numThreads; ++i)
+    {
+        scheduler.queues[i].chunks.store((static_cast<uint64_t>(bounds[i + 1]) << 32) | bounds[i]);
+    }
+
+    if (scheduler.numWorkers > 0)
+    {
+        // Parked workers only need a notify if they counted themselves parked before the bump
+        scheduler.activeWorkers.store(scheduler.numWorkers);
+        scheduler.launchTime = ChunkTime();
+        scheduler.generation.fetch_add(1);
+        if (scheduler.parkedWorkers.load() > 0)
+        {
+            std::unique_lock<std::mutex> l(scheduler.lock);
+            scheduler.workReady.notify_all();
+        }
+        ++scheduler.threads[0].runs;
+    }
+
+    // This main thread also runs chunks, then waits for the workers to finish theirs
+    RunChunks(scheduler, 0);
+
+    if (scheduler.numWorkers > 0)
+    {
+        PROFILE_SCOPE(PROFILE_WAIT);
+        uint64_t waitStart = ChunkTime();
+        auto done = [&]() { return scheduler.activeWorkers.load() == 0; };
+        if (!SpinUntil(done, scheduler.spinNanoseconds))
+        {
+            std::unique_lock<std::mutex> l(scheduler.lock);
+            scheduler.callerParked.store(true);
+            scheduler.workDone.wait(l, done);
+            scheduler.callerParked.store(false);
+        }
+        scheduler.threads[0].waitTime += ChunkTime() - waitStart;
+    }
+
+    if (partition)
+    {
+        UpdatePartition(*partition, bounds, dealtByCost, numChunks, numThreads);
+    }
+}
@@ -0,0 +1,284 @@
+// JobScheduler.h: Work-stealing ParallelFor over a pool of worker threads
+#pragma once
+
+#include "Memory.h"
+#include <cstdint>
+#include <thread>
+#include <condition_variable>
+#include <mutex>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Job Scheduler
+//---------------------------------------------------------------------------------------------------------------------
+
+// ParallelFor splits a range into fixed size chunks and deals each thread a contiguous run of them. A thread takes
+// chunks from the front of its own run, and once that is empty steals from the back of other threads' runs, so threads
+// that get through their chunks quickly take over work from threads in denser regions. Every chunk is run exactly once.
+// Thread 0 is the thread calling ParallelFor, which works on every ParallelFor alongside the worker threads. That is the
+// main thread, or the simulation thread while a SimulationPipeline runs, never both at once.
+// The functions without a JobScheduler argument use the global scheduler that steps the world. Work that has to run
+// alongside a step, like stationary queries, gets a JobScheduler of its own with its own workers and calling thread
+
+static const uint32_t MAX_WORKERS = 31;
+static const uint32_t MAX_THREADS = MAX_WORKERS + 1;
+
+//Number of moving circles in each chunk of a ParallelFor
+const uint32_t CHUNK_SIZE = 128;
+
+typedef void (*ChunkFn)(void* context, uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread);
+
+// The chunks of a ParallelFor are dealt evenly by count, but a chunk of circles in a dense region can cost many times one
+// in an empty region, and stealing only evens that out late and at the cost of cache misses. A ParallelFor given a
+// ChunkPartition times every chunk it runs, then deals the next run over the same range from a prefix sum of those
+// costs, so each thread starts with about the same amount of work. Keep one per call site, as the costs of one loop say
+// nothing about another's.
+// One run's times are noisy, a chunk that is preempted or faults in a page can take many times its usual cost, so the
+// deal comes from a moving average of each chunk's cost with outliers clipped. Each run also scores the bounds the
+// average gave against an even deal, by the costs the run measured, and the next run is dealt by cost only while that
+// has been scoring better
+
+//Runs a chunk's cost is averaged over, as the weight of the newest run is one over this
+const uint32_t PARTITION_SMOOTHING = 8;
+
+//Most a chunk's time counts for, as a multiple of its average or the run's mean chunk time if more, so one slow run
+//barely moves the bounds
+const uint64_t PARTITION_OUTLIER = 4;
+
+//Totals of one thread in a ChunkPartition's runs, on a cache line of its own as every thread adds to its own at once
+struct alignas(CACHE_LINE_SIZE) PartitionThreadTotals
+{
+    uint64_t busy = 0;   //Nanoseconds running chunks, stolen ones included
+    uint64_t stolen = 0; //Chunks stolen
+};
+
+struct ChunkPartition
+{
+    std::vector<uint64_t> costs;               //Nanoseconds each chunk took in the last run
+    std::vector<uint64_t> averages;            //Moving average of each chunk's cost, what the bounds are worked out from
+    uint32_t costBounds[MAX_THREADS + 1] = {}; //First chunk of each thread's run by the averages
+    uint32_t bounds[MAX_THREADS + 1] = {};     //First chunk of each thread's run next time, costBounds or an even deal
+    uint32_t numChunks = 0;                    //What bounds were worked out for, a run of any other shape is dealt evenly
+    uint32_t numThreads = 0;
+    double costScore = 0.0;                    //Moving averages of the imbalance costBounds and an even deal would have
+    double evenScore = 0.0;                    //had in each run, by the costs measured in it
+    bool scored = false;
+    bool dealByCost = false;                   //Whether bounds are costBounds
+
+    // Totals over every run, for reporting. Imbalance is the costliest thread's run over the mean, 1 when even
+    uint32_t runs = 0;
+    uint32_t costRuns = 0;                     //Runs dealt by cost rather than evenly
+    PartitionThreadTotals threads[MAX_THREADS];
+    double dealtImbalance = 0.0;               //Of the runs as dealt, by the chunk costs measured in them
+    double evenImbalance = 0.0;                //Of the runs an even deal would have given, by the same costs
+    uint32_t scoredRuns = 0;                   //Runs costBounds were scored in, every one after the first of its shape
+    double scoredCostImbalance = 0.0;          //Of those runs, had they been dealt by costBounds
+    double scoredEvenImbalance = 0.0;          //Of the same runs dealt evenly
+};
+
+// Handing out a ParallelFor bumps a generation counter and the caller then waits for a count of active workers to reach
+// zero. Either side spins on its counter for a while before parking on a condition variable, so a ParallelFor following
+// closely on the last one is picked up without a kernel call, while idle threads between frames still sleep. When there
+// are more threads than cores spinning would only hold up the threads with work, so they park straight away.
+// With pinThreads set before StartScheduler, worker i is pinned to core i, wrapping round, leaving the calling thread free
+// to move as it can be the main thread or the pipeline's
+
+//Nanoseconds a waiting thread spins before it parks
+const uint64_t SCHEDULER_SPIN_NANOSECONDS = 50000;
+
+//Counts one thread of a scheduler keeps, on a cache line of its own so updating them never disturbs another thread
+struct alignas(CACHE_LINE_SIZE) SchedulerThreadState
+{
+    uint64_t seen = 0;     //Last generation the thread ran
+    uint64_t runs = 0;     //ParallelFors the thread joined
+    uint64_t parks = 0;    //Of those, ones that found it parked
+    uint64_t wakeTime = 0; //Nanoseconds from each being handed out to the thread starting on it
+    uint64_t waitTime = 0; //Thread 0 only, nanoseconds waiting for the workers to finish once out of chunks
+};
+
+//Totals of a scheduler's SchedulerThreadStates
+struct SchedulerStats
+{
+    uint64_t runs = 0;       //ParallelFors handed to the workers
+    uint64_t wakes = 0;      //Workers starting on one
+    uint64_t parks = 0;      //Of those, ones that had parked
+    uint64_t wakeTime = 0;   //Nanoseconds from a ParallelFor being handed out to each worker starting on it
+    uint64_t finishWait = 0; //Nanoseconds thread 0 waited for the workers to finish
+};
+
+// A thread's run of chunk indices, front in the low 32 bits and back in the high 32 bits, so taking a chunk from either
+// end is a single compare-exchange. Each run is on its own cache line as every thread polls the others when stealing
+struct alignas(64) ChunkQueue
+{
+    std::atomic<uint64_t> chunks;
+};
+
+struct JobScheduler
+{
+    std::thread workers[MAX_WORKERS];
+    uint32_t numWorkers = 0;
+    ChunkQueue queues[MAX_THREADS];
+    SchedulerThreadState threads[MAX_THREADS];
+
+    // The ParallelFor being run, published to the workers by the generation bump
+    ChunkFn fn;
+    void* context;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t chunkSize;
+    ChunkPartition* partition; //Null when the chunks aren't timed
+    uint64_t launchTime;
+
+    // Workers wait for generation to change and the calling thread for activeWorkers to reach zero, each counter on its
+    // own cache line. The mutex only guards parking, the parked counts tell the other side it has to notify
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> generation{ 0 };
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> activeWorkers{ 0 };
+    alignas(CACHE_LINE_SIZE) std::mutex lock;
+    std::condition_variable workReady;
+    std::condition_variable workDone;
+    std::atomic<uint32_t> parkedWorkers{ 0 };
+    std::atomic<bool> callerParked{ false };
+    std::atomic<bool> stopping{ false };
+    uint64_t spinNanoseconds = 0;
+
+    bool pinThreads = false;
+    const char* threadName = "Worker"; //Workers' name in profiles
+};
+
+extern JobScheduler scheduler;
+
+//Starts numWorkers worker threads, the calling thread becomes thread 0
+void StartScheduler(JobScheduler& jobs, uint32_t numWorkers);
+
+inline void StartScheduler(uint32_t numWorkers)
+{
+    StartScheduler(scheduler, numWorkers);
+}
+
+//Joins the worker threads
+void StopScheduler(JobScheduler& jobs);
+
+inline void StopScheduler()
+{
+    StopScheduler(scheduler);
+}
+
+//Totals since StartScheduler, call on the calling thread between ParallelFors
+SchedulerStats GetSchedulerStats(const JobScheduler& jobs);
+
+//Worker threads plus the main thread
+inline uint32_t NumSchedulerThreads(const JobScheduler& jobs)
+{
+    return jobs.numWorkers + 1;
+}
+
+inline uint32_t NumSchedulerThreads()
+{
+    return NumSchedulerThreads(scheduler);
+}
+
+//Runs fn over [begin, end) in chunks on every thread of jobs and returns once all chunks are done. With a partition the
+//chunks are dealt by the costs it holds, then timed to update them
+void RunParallelFor(JobScheduler& jobs, uint32_t begin, uint32_t end, uint32_t chunkSize, ChunkFn fn, void* context, ChunkPartition* partition);
+
+inline void RunParallelFor(uint32_t begin, uint32_t end, uint32_t chunkSize, ChunkFn fn, void* context, ChunkPartition* partition)
+{
+    RunParallelFor(scheduler, begin, end, chunkSize, fn, context, partition);
+}
+
+//Calls fn(chunkBegin, chunkEnd, thread) for every chunk of [begin, end), spread across all threads of jobs
+template <typename Fn>
+void ParallelFor(JobScheduler& jobs, uint32_t begin, uint32_t end, uint32_t chunkSize, Fn&& fn)
+{
+    typedef typename std::remove_reference<Fn>::type Callable;
+    RunParallelFor(jobs, begin, end, chunkSize, [](void* context, uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        (*static_cast<Callable*>(context))(chunkBegin, chunkEnd, thread);
+    }, &fn, nullptr);
+}
+
+//As above on the global scheduler
+template <typename Fn>
+void ParallelFor(uint32_t begin, uint32_t end, uint32_t chunkSize, Fn&& fn)
+{
+    ParallelFor(scheduler, begin, end, chunkSize, std::forward<Fn>(fn));
+}
+
+//As ParallelFor, with the chunks dealt to the threads by their cost in the last run through partition
+template <typename Fn>
+void ParallelFor(uint32_t begin, uint32_t end, uint32_t chunkSize, ChunkPartition& partition, Fn&& fn)
+{
+    typedef typename std::remove_reference<Fn>::type Callable;
+    RunParallelFor(begin, end, chunkSize, [](void* context, uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        (*static_cast<Callable*>(context))(chunkBegin, chunkEnd, thread);
+    }, &fn, &partition);
+}
+
+//Sorts [data, data + count) on every thread: one run per thread is sorted, then pairs of runs are merged in rounds, each
+//pair on a thread. less must be a strict total order, equal elements identical, for the result not to depend on the
+//thread count
+template <typename T, typename Less>
+void ParallelSort(T* data, uint32_t count, Less less)
+{
+    uint32_t numRuns = NumSchedulerThreads();
+    if (numRuns == 1 || count < numRuns * CHUNK_SIZE)
+    {
+        std::sort(data, data + count, less);
+        return;
+    }
+
+    uint32_t runSize = (count + numRuns - 1) / numRuns;
+    ParallelFor(0, count, runSize, [&](uint32_t runBegin, uint32_t runEnd, uint32_t thread)
+    {
+        std::sort(data + runBegin, data + runEnd, less);
+    });
+
+    AlignedVector<T> buffer(count);
+    T* from = data;
+    T* to = buffer.data();
+    for (uint64_t width = runSize; width < count; width *= 2)
+    {
+        uint32_t pairSize = static_cast<uint32_t>(std::min<uint64_t>(width * 2, count));
+        ParallelFor(0, count, pairSize, [&](uint32_t pairBegin, uint32_t pairEnd, uint32_t thread)
+        {
+            uint32_t mid = static_cast<uint32_t>(std::min<uint64_t>(pairBegin + width, pairEnd));
+            std::merge(from + pairBegin, from + mid, from + mid, from + pairEnd, to + pairBegin, less);
+        });
+        std::swap(from, to);
+    }
+    if (from != data)
+    {
+        std::copy(from, from + count, data);
+    }
+}
+
+//Resizes array to count elements. When that needs new storage, the elements are copied over and the new ones zeroed in
+//ParallelFor chunks, so on a NUMA machine each page is first written, and so placed, by the thread dealt those chunks,
+//which is the thread that mostly works on them in every later ParallelFor over the array. Otherwise new elements are
+//left uninitialised, either way the caller is expected to fill them
+template <typename T>
+void ParallelResize(AlignedVector<T>& array, uint32_t count)
+{
+    if (count <= array.capacity())
+    {
+        array.resize(count);
+        return;
+    }
+
+    AlignedVector<T> resized(count);
+    uint32_t numKept = static_cast<uint32_t>(std::min<size_t>(array.size(), count));
+    const T* from = array.data();
+    T* to = resized.data();
+    ParallelFor(0, count, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        uint32_t keptEnd = std::max(chunkBegin, std::min(chunkEnd, numKept));
+        std::copy(from + chunkBegin, from + keptEnd, to + chunkBegin);
+        std::fill(to + keptEnd, to + chunkEnd, T());
+    });
+    array.swap(resized);
+}
@@ -0,0 +1,67 @@
+// MappedFile.cpp: Read-only memory mapping of a whole file
+
+#include "MappedFile.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+void UnmapFile(MappedFile& mapped)
+{
+#if defined(_WIN32)
+    if (mapped.data)  UnmapViewOfFile(mapped.data);
+    if (mapped.mapping)  CloseHandle(mapped.mapping);
+    if (mapped.file != INVALID_HANDLE_VALUE)  CloseHandle(mapped.file);
+    mapped.file = INVALID_HANDLE_VALUE;
+    mapped.mapping = nullptr;
+#else
+    if (mapped.data)  munmap(const_cast<uint8_t*>(mapped.data), mapped.size);
+    if (mapped.file >= 0)  close(mapped.file);
+    mapped.file = -1;
+#endif
+    mapped.data = nullptr;
+    mapped.size = 0;
+}
+
+bool MapFile(MappedFile& mapped, const char* path)
+{
+#if defined(_WIN32)
+    mapped.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER size;
+    if (mapped.file == INVALID_HANDLE_VALUE || !GetFileSizeEx(mapped.file, &size) || size.QuadPart == 0)
+    {
+        UnmapFile(mapped);
+        return false;
+    }
+    mapped.size = static_cast<uint64_t>(size.QuadPart);
+    mapped.mapping = CreateFileMappingA(mapped.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapped.mapping)
+    {
+        mapped.data = static_cast<const uint8_t*>(MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    mapped.file = open(path, O_RDONLY);
+    struct stat info;
+    if (mapped.file < 0 || fstat(mapped.file, &info) != 0 || info.st_size == 0)
+    {
+        UnmapFile(mapped);
+        return false;
+    }
+    mapped.size = static_cast<uint64_t>(info.st_size);
+    void* data = mmap(nullptr, mapped.size, PROT_READ, MAP_PRIVATE, mapped.file, 0);
+    if (data != MAP_FAILED)
+    {
+        mapped.data = static_cast<const uint8_t*>(data);
+        madvise(data, mapped.size, MADV_SEQUENTIAL);
+    }
+#endif
+    if (!mapped.data)
+    {
+        UnmapFile(mapped);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+// MappedFile.h: Read-only memory mapping of a whole file
+#pragma once
+
+#include <cstdint>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+//Read-only view of a whole file
+struct MappedFile
+{
+    const uint8_t* data = nullptr;
+    uint64_t size = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int file = -1;
+#endif
+};
+
+//Maps the whole of path, returns false if it can't be opened or is empty
+bool MapFile(MappedFile& mapped, const char* path);
+
+//Unmaps and closes the file, safe to call on one that failed to map
+void UnmapFile(MappedFile& mapped);
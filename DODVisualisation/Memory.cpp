@@ -0,0 +1,131 @@
+// Memory.cpp: Cache line aligned arrays, mapped from the OS and optionally on huge pages once they are big enough
+
+#include "Memory.h"
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+static std::atomic<bool> hugePages{ false };
+
+bool EnableHugePages(bool enable)
+{
+    if (!enable)
+    {
+        hugePages.store(false, std::memory_order_relaxed);
+        return true;
+    }
+
+#if defined(_WIN32)
+    // Large pages are locked in memory, so the process has to switch the right on before it can have any
+    HANDLE token;
+    bool enabled = false;
+    if (OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+    {
+        TOKEN_PRIVILEGES privileges = {};
+        privileges.PrivilegeCount = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        enabled = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid)
+            && AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr)
+            && GetLastError() == ERROR_SUCCESS; // ERROR_NOT_ALL_ASSIGNED if the account doesn't hold the right
+        CloseHandle(token);
+    }
+    if (!enabled || GetLargePageMinimum() == 0)
+    {
+        std::cout << "Huge pages need the \"Lock pages in memory\" right, using normal pages" << std::endl;
+        return false;
+    }
+#elif defined(MADV_HUGEPAGE)
+    std::ifstream mode("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string modes;
+    if (!std::getline(mode, modes) || modes.find("[never]") != std::string::npos)
+    {
+        std::cout << "Transparent huge pages are off, using normal pages" << std::endl;
+        return false;
+    }
+#else
+    std::cout << "Huge pages are not supported on this platform, using normal pages" << std::endl;
+    return false;
+#endif
+
+    hugePages.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+//Whole huge pages, so a mapping can start and end on a huge page boundary
+static std::size_t MappedSize(std::size_t bytes)
+{
+    return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+void* AllocateArray(std::size_t bytes)
+{
+    if (bytes < HUGE_PAGE_SIZE)
+    {
+        return AlignedAlloc(bytes, CACHE_LINE_SIZE);
+    }
+
+    std::size_t size = MappedSize(bytes);
+#if defined(_WIN32)
+    // Large pages are committed, and so placed, by this thread. A multiple of the large page size is already a multiple of
+    // HUGE_PAGE_SIZE, but not the other way round
+    if (hugePages.load(std::memory_order_relaxed))
+    {
+        std::size_t largePage = GetLargePageMinimum();
+        std::size_t largeSize = (size + largePage - 1) / largePage * largePage;
+        if (largeSize == size)
+        {
+            if (void* p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE))
+            {
+                return p;
+            }
+        }
+    }
+    return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    // Over-map by a huge page so the start can be moved up to a boundary, then hand back both ends. Pages of an anonymous
+    // mapping are only backed once written
+    void* mapped = mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    uintptr_t start = (reinterpret_cast<uintptr_t>(mapped) + HUGE_PAGE_SIZE - 1) & ~static_cast<uintptr_t>(HUGE_PAGE_SIZE - 1);
+    std::size_t head = start - reinterpret_cast<uintptr_t>(mapped);
+    if (head > 0)
+    {
+        munmap(mapped, head);
+    }
+    munmap(reinterpret_cast<void*>(start + size), HUGE_PAGE_SIZE - head);
+#if defined(MADV_HUGEPAGE)
+    if (hugePages.load(std::memory_order_relaxed))
+    {
+        madvise(reinterpret_cast<void*>(start), size, MADV_HUGEPAGE);
+    }
+#endif
+    return reinterpret_cast<void*>(start);
+#endif
+}
+
+void FreeArray(void* p, std::size_t bytes)
+{
+    if (bytes < HUGE_PAGE_SIZE)
+    {
+        AlignedFree(p);
+        return;
+    }
+#if defined(_WIN32)
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, MappedSize(bytes));
+#endif
+}
@@ -0,0 +1,111 @@
+// Memory.h: Aligned storage for the simulation arrays
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+inline void* AlignedAlloc(std::size_t size, std::size_t alignment)
+{
+#if defined(_MSC_VER)
+    return _aligned_malloc(size, alignment);
+#else
+    void* p = nullptr;
+    return posix_memalign(&p, alignment, size) == 0 ? p : nullptr;
+#endif
+}
+
+inline void AlignedFree(void* p)
+{
+#if defined(_MSC_VER)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Simulation Arrays
+//---------------------------------------------------------------------------------------------------------------------
+
+// Every per-circle array of the world comes from AllocateArray. Arrays start on a cache line, so the widest SIMD load is
+// aligned and a chunk boundary never splits a line between two arrays. Arrays of at least HUGE_PAGE_SIZE are mapped
+// straight from the OS on a HUGE_PAGE_SIZE boundary, so with huge pages enabled the TLB covers millions of circles with a
+// few hundred entries.
+// Nothing here writes the memory it hands out, and AlignedVector leaves new elements uninitialised. On a NUMA machine a
+// page is placed on the node of the thread that first writes it, so whatever fills an array decides where it lives, see
+// ParallelResize in JobScheduler.h
+
+const std::size_t CACHE_LINE_SIZE = 64;
+const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+//Backs arrays allocated from now on with huge pages, where the OS allows it. Returns false, after saying why, if it doesn't.
+//On Windows this needs the "Lock pages in memory" right, on Linux transparent huge pages in madvise or always mode
+bool EnableHugePages(bool enable);
+
+//Returns null if the memory can't be had
+void* AllocateArray(std::size_t bytes);
+
+//bytes must be what p was allocated with
+void FreeArray(void* p, std::size_t bytes);
+
+// Allocator so std::vector storage comes from AllocateArray. Elements constructed without a value are left uninitialised,
+// so resizing an array doesn't write, and so place, every page of it on the resizing thread
+template <typename T>
+struct AlignedAllocator
+{
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef AlignedAllocator<U> other;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(std::size_t n)
+    {
+        void* p = AllocateArray(n * sizeof(T));
+        if (!p)
+        {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        FreeArray(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    void construct(U* p)
+    {
+        ::new (static_cast<void*>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
@@ -0,0 +1,411 @@
+// NarrowPhase.cpp: SIMD kernels testing a moving circle against runs of SoA stationary circles
+
+#include "NarrowPhase.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define DOD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define DOD_X86 0
+#endif
+
+// GCC and Clang only allow intrinsics for the instruction set a function is built for, MSVC allows them anywhere
+#if defined(__GNUC__)
+#define DOD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define DOD_TARGET(isa)
+#endif
+
+// With Uniform every stationary circle has the same radius and rad is not read: mrad is the contact distance, the sum of
+// both radii, and stopX is tested against the centres. The squared contact distance is worked out once per call
+template <bool Uniform>
+static uint32_t FindFirstContactScalar(const float* x, const float* y, const float* rad, uint32_t begin, uint32_t end, float mx, float my, float mrad, float stopX)
+{
+    const float contact = mrad * mrad;
+
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        if (Uniform ? !(stopX > x[i]) : !(stopX > x[i] - rad[i]))
+        {
+            return NO_CONTACT;
+        }
+        if (Uniform ? UniformCirclesOverlap(x[i] - mx, y[i] - my, contact) : CirclesOverlap(x[i] - mx, y[i] - my, mrad + rad[i]))
+        {
+            return i;
+        }
+    }
+    return NO_CONTACT;
+}
+
+template <bool Uniform>
+static uint32_t FindLastContactScalar(const float* x, const float* y, const float* rad, uint32_t begin, uint32_t end, float mx, float my, float mrad, float stopX)
+{
+    const float contact = mrad * mrad;
+
+    for (uint32_t i = end; i-- > begin;)
+    {
+        if (Uniform ? !(stopX < x[i]) : !(stopX < x[i] + rad[i]))
+        {
+            return NO_CONTACT;
+        }
+        if (Uniform ? UniformCirclesOverlap(x[i] - mx, y[i] - my, contact) : CirclesOverlap(x[i] - mx, y[i] - my, mrad + rad[i]))
+        {
+            return i;
+        }
+    }
+    return NO_CONTACT;
+}
+
+#if DOD_X86
+
+inline uint32_t LowestBit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanForward(&bit, mask);
+    return bit;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+inline uint32_t HighestBit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanReverse(&bit, mask);
+    return bit;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+// Lane masks of the stop and hit tests for a block of candidates. The nearest lane with either bit set decides the
+// block, exactly as the scalar loop would: a stop bit ends the scan, a hit bit is the contact
+inline uint32_t FirstBlockResult(uint32_t stopMask, uint32_t hitMask, uint32_t blockStart)
+{
+    uint32_t lane = LowestBit(stopMask | hitMask);
+    return (stopMask >> lane) & 1 ? NO_CONTACT : blockStart + lane;
+}
+
+inline uint32_t LastBlockResult(uint32_t stopMask, uint32_t hitMask, uint32_t blockStart)
+{
+    uint32_t lane = HighestBit(stopMask | hitMask);
+    return (stopMask >> lane) & 1 ? NO_CONTACT : blockStart + lane;
+}
+
+template <bool Uniform>
+DOD_TARGET("sse4.1")
+static uint32_t FindFirstContactSSE41(const float* x, const float* y, const float* rad, uint32_t begin, uint32_t end, float mx, float my, float mrad, float stopX)
+{
+    const __m128 vmx = _mm_set1_ps(mx);
+    const __m128 vmy = _mm_set1_ps(my);
+    const __m128 vmrad = _mm_set1_ps(mrad);
+    const __m128 vstop = _mm_set1_ps(stopX);
+    const __m128 vcontact = _mm_set1_ps(mrad * mrad);
+
+    uint32_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 sx = _mm_loadu_ps(x + i);
+        __m128 sy = _mm_loadu_ps(y + i);
+
+        __m128 dx = _mm_sub_ps(sx, vmx);
+        __m128 dy = _mm_sub_ps(sy, vmy);
+        __m128 dist = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+        uint32_t stopMask;
+        uint32_t hitMask;
+        if (Uniform)
+        {
+            stopMask = _mm_movemask_ps(_mm_cmpngt_ps(vstop, sx));
+            hitMask = _mm_movemask_ps(_mm_cmplt_ps(dist, vcontact));
+        }
+        else
+        {
+            __m128 srad = _mm_loadu_ps(rad + i);
+            __m128 radsum = _mm_add_ps(vmrad, srad);
+            stopMask = _mm_movemask_ps(_mm_cmpngt_ps(vstop, _mm_sub_ps(sx, srad)));
+            hitMask = _mm_movemask_ps(_mm_cmplt_ps(dist, _mm_mul_ps(radsum, radsum)));
+        }
+        if (stopMask | hitMask)
+        {
+            return FirstBlockResult(stopMask, hitMask, i);
+        }
+    }
+    return FindFirstContactScalar<Uniform>(x, y, rad, i, end, mx, my, mrad, stopX);
+}
+
+template <bool Uniform>
+DOD_TARGET("sse4.1")
+static uint32_t FindLastContactSSE41(const float* x, const float* y, const float* rad, uint32_t begin, uint32_t end, float mx, float my, float mrad, float stopX)
+{
+    const __m128 vmx = _mm_set1_ps(mx);
+    const __m128 vmy = _mm_set1_ps(my);
+    const __m128 vmrad = _mm_set1_ps(mrad);
+    const __m128 vstop = _mm_set1_ps(stopX);
+    const __m128 vcontact = _mm_set1_ps(mrad * mrad);
+
+    uint32_t i = end;
+    for (; i >= begin + 4; i -= 4)
+    {
+        __m128 sx = _mm_loadu_ps(x + i - 4);
+        __m128 sy = _mm_loadu_ps(y + i - 4);
+
+        __m128 dx = _mm_sub_ps(sx, vmx);
+        __m128 dy = _mm_sub_ps(sy, vmy);
+        __m128 dist = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+        uint32_t stopMask;
+        uint32_t hitMask;
+        if (Uniform)
+        {
+            stopMask = _mm_movemask_ps(_mm_cmpnlt_ps(vstop, sx));
+            hitMask = _mm_movemask_ps(_mm_cmplt_ps(dist, vcontact));
+        }
+        else
+        {
+            __m128 srad = _mm_loadu_ps(rad + i - 4);
+            __m128 radsum = _mm_add_ps(vmrad, srad);
+            stopMask = _mm_movemask_ps(_mm_cmpnlt_ps(vstop, _mm_add_ps(sx, srad)));
+            hitMask = _mm_movemask_ps(_mm_cmplt_ps(dist, _mm_mul_ps(radsum, radsum)));
+        }
+        if (stopMask | hitMask)
+        {
+            return LastBlockResult(stopMask, hitMask, i - 4);
+        }
+    }
+    return FindLastContactScalar<Uniform>(x, y, rad, begin, i, mx, my, mrad, stopX);
+}
+
+template <bool Uniform>
+DOD_TARGET("avx2")
+static uint32_t FindFirstContactAVX2(const float* x, const float* y, const float* rad, uint32_t begin, uint32_t end, float mx, float my, float mrad, float stopX)
+{
+    const __m256 vmx = _mm256_set1_ps(mx);
+    const __m256 vmy = _mm256_set1_ps(my);
+    const __m256 vmrad = _mm256_set1_ps(mrad);
+    const __m256 vstop = _mm256_set1_ps(stopX);
+    const __m256 vcontact = _mm256_set1_ps(mrad * mrad);
+
+    uint32_t i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 sx = _mm256_loadu_ps(x + i);
+        __m256 sy = _mm256_loadu_ps(y + i);
+
+        __m256 dx = _mm256_sub_ps(sx, vmx);
+        __m256 dy = _mm256_sub_ps(sy, vmy);
+        __m256 dist = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+
+        uint32_t stopMask;
+        uint32_t hitMask;
+        if (Uniform)
+        {
+            stopMask = _mm256_movemask_ps(_mm256_cmp_ps(vstop, sx, _CMP_NGT_UQ));
+            hitMask = _mm256_movemask_ps(_mm256_cmp_ps(dist, vcontact, _CMP_LT_OQ));
+        }
+        else
+        {
+            __m256 srad = _mm256_loadu_ps(rad + i);
+            __m256 radsum = _mm256_add_ps(vmrad, srad);
+            stopMask = _mm256_movemask_ps(_mm256_cmp_ps(vstop, _mm256_sub_ps(sx, srad), _CMP_NGT_UQ));
+            hitMask = _mm256_movemask_ps(_mm256_cmp_ps(dist, _mm256_mul_ps(radsum, radsum), _CMP_LT_OQ));
+        }
+        if (stopMask | hitMask)
+        {
+            return FirstBlockResult(stopMask, hitMask, i);
+        }
+    }
+    return FindFirstContactScalar<Uniform>(x, y, rad, i, end, mx, my, mrad, stopX);
+}
+
+template <bool Uniform>
+DOD_TARGET("avx2")
+static uint32_t FindLastContactAVX2(const float* x, const float* y, const float* rad, uint32_t begin, uint32_t end, float mx, float my, float mrad, float stopX)
+{
+    const __m256 vmx = _mm256_set1_ps(mx);
+    const __m256 vmy = _mm256_set1_ps(my);
+    const __m256 vmrad = _mm256_set1_ps(mrad);
+    const __m256 vstop = _mm256_set1_ps(stopX);
+    const __m256 vcontact = _mm256_set1_ps(mrad * mrad);
+
+    uint32_t i = end;
+    for (; i >= begin + 8; i -= 8)
+    {
+        __m256 sx = _mm256_loadu_ps(x + i - 8);
+        __m256 sy = _mm256_loadu_ps(y + i - 8);
+
+        __m256 dx = _mm256_sub_ps(sx, vmx);
+        __m256 dy = _mm256_sub_ps(sy, vmy);
+        __m256 dist = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+
+        uint32_t stopMask;
+        uint32_t hitMask;
+        if (Uniform)
+        {
+            stopMask = _mm256_movemask_ps(_mm256_cmp_ps(vstop, sx, _CMP_NLT_UQ));
+            hitMask = _mm256_movemask_ps(_mm256_cmp_ps(dist, vcontact, _CMP_LT_OQ));
+        }
+        else
+        {
+            __m256 srad = _mm256_loadu_ps(rad + i - 8);
+            __m256 radsum = _mm256_add_ps(vmrad, srad);
+            stopMask = _mm256_movemask_ps(_mm256_cmp_ps(vstop, _mm256_add_ps(sx, srad), _CMP_NLT_UQ));
+            hitMask = _mm256_movemask_ps(_mm256_cmp_ps(dist, _mm256_mul_ps(radsum, radsum), _CMP_LT_OQ));
+        }
+        if (stopMask | hitMask)
+        {
+            return LastBlockResult(stopMask, hitMask, i - 8);
+        }
+    }
+    return FindLastContactScalar<Uniform>(x, y, rad, begin, i, mx, my, mrad, stopX);
+}
+
+template <bool Uniform>
+DOD_TARGET("avx512f")
+static uint32_t FindFirstContactAVX512(const float* x, const float* y, const float* rad, uint32_t begin, uint32_t end, float mx, float my, float mrad, float stopX)
+{
+    const __m512 vmx = _mm512_set1_ps(mx);
+    const __m512 vmy = _mm512_set1_ps(my);
+    const __m512 vmrad = _mm512_set1_ps(mrad);
+    const __m512 vstop = _mm512_set1_ps(stopX);
+    const __m512 vcontact = _mm512_set1_ps(mrad * mrad);
+
+    uint32_t i = begin;
+    for (; i + 16 <= end; i += 16)
+    {
+        __m512 sx = _mm512_loadu_ps(x + i);
+        __m512 sy = _mm512_loadu_ps(y + i);
+
+        __m512 dx = _mm512_sub_ps(sx, vmx);
+        __m512 dy = _mm512_sub_ps(sy, vmy);
+        __m512 dist = _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+
+        uint32_t stopMask;
+        uint32_t hitMask;
+        if (Uniform)
+        {
+            stopMask = _mm512_cmp_ps_mask(vstop, sx, _CMP_NGT_UQ);
+            hitMask = _mm512_cmp_ps_mask(dist, vcontact, _CMP_LT_OQ);
+        }
+        else
+        {
+            __m512 srad = _mm512_loadu_ps(rad + i);
+            __m512 radsum = _mm512_add_ps(vmrad, srad);
+            stopMask = _mm512_cmp_ps_mask(vstop, _mm512_sub_ps(sx, srad), _CMP_NGT_UQ);
+            hitMask = _mm512_cmp_ps_mask(dist, _mm512_mul_ps(radsum, radsum), _CMP_LT_OQ);
+        }
+        if (stopMask | hitMask)
+        {
+            return FirstBlockResult(stopMask, hitMask, i);
+        }
+    }
+    return FindFirstContactScalar<Uniform>(x, y, rad, i, end, mx, my, mrad, stopX);
+}
+
+template <bool Uniform>
+DOD_TARGET("avx512f")
+static uint32_t FindLastContactAVX512(const float* x, const float* y, const float* rad, uint32_t begin, uint32_t end, float mx, float my, float mrad, float stopX)
+{
+    const __m512 vmx = _mm512_set1_ps(mx);
+    const __m512 vmy = _mm512_set1_ps(my);
+    const __m512 vmrad = _mm512_set1_ps(mrad);
+    const __m512 vstop = _mm512_set1_ps(stopX);
+    const __m512 vcontact = _mm512_set1_ps(mrad * mrad);
+
+    uint32_t i = end;
+    for (; i >= begin + 16; i -= 16)
+    {
+        __m512 sx = _mm512_loadu_ps(x + i - 16);
+        __m512 sy = _mm512_loadu_ps(y + i - 16);
+
+        __m512 dx = _mm512_sub_ps(sx, vmx);
+        __m512 dy = _mm512_sub_ps(sy, vmy);
+        __m512 dist = _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+
+        uint32_t stopMask;
+        uint32_t hitMask;
+        if (Uniform)
+        {
+            stopMask = _mm512_cmp_ps_mask(vstop, sx, _CMP_NLT_UQ);
+            hitMask = _mm512_cmp_ps_mask(dist, vcontact, _CMP_LT_OQ);
+        }
+        else
+        {
+            __m512 srad = _mm512_loadu_ps(rad + i - 16);
+            __m512 radsum = _mm512_add_ps(vmrad, srad);
+            stopMask = _mm512_cmp_ps_mask(vstop, _mm512_add_ps(sx, srad), _CMP_NLT_UQ);
+            hitMask = _mm512_cmp_ps_mask(dist, _mm512_mul_ps(radsum, radsum), _CMP_LT_OQ);
+        }
+        if (stopMask | hitMask)
+        {
+            return LastBlockResult(stopMask, hitMask, i - 16);
+        }
+    }
+    return FindLastContactScalar<Uniform>(x, y, rad, begin, i, mx, my, mrad, stopX);
+}
+
+#endif
+
+SimdLevel DetectSimdLevel()
+{
+#if DOD_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool ymmSaved = (xcr0 & 0x6) == 0x6;
+    bool zmmSaved = (xcr0 & 0xE6) == 0xE6;
+
+    bool avx2 = false;
+    bool avx512 = false;
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+        avx512 = (info[1] & (1 << 16)) != 0;
+    }
+
+    if (avx512 && zmmSaved) return SimdLevel::AVX512;
+    if (avx2 && ymmSaved) return SimdLevel::AVX2;
+    if (sse41) return SimdLevel::SSE41;
+    return SimdLevel::Scalar;
+#elif DOD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return SimdLevel::SSE41;
+    return SimdLevel::Scalar;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+//Both variants of a kernel for the table below
+#define DOD_KERNELS(isa) &FindFirstContact##isa<false>, &FindLastContact##isa<false>, &FindFirstContact##isa<true>, &FindLastContact##isa<true>
+
+NarrowPhaseKernel SelectNarrowPhaseKernel(SimdLevel maxLevel)
+{
+    SimdLevel level = std::min(DetectSimdLevel(), maxLevel);
+#if DOD_X86
+    switch (level)
+    {
+    case SimdLevel::AVX512: return { level, "AVX-512", DOD_KERNELS(AVX512) };
+    case SimdLevel::AVX2:   return { level, "AVX2", DOD_KERNELS(AVX2) };
+    case SimdLevel::SSE41:  return { level, "SSE4.1", DOD_KERNELS(SSE41) };
+    default: break;
+    }
+#endif
+    return { SimdLevel::Scalar, "Scalar", DOD_KERNELS(Scalar) };
+}
+
+NarrowPhaseKernel narrowPhase = { SimdLevel::Scalar, "Scalar", DOD_KERNELS(Scalar) };
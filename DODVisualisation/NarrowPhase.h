@@ -0,0 +1,59 @@
+// NarrowPhase.h: SIMD kernels testing a moving circle against runs of SoA stationary circles
+#pragma once
+
+#include <cstdint>
+
+//Instruction sets the narrow phase kernels are built for
+enum class SimdLevel
+{
+    Scalar,
+    SSE41,
+    AVX2,
+    AVX512
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Narrow Phase Kernels
+//---------------------------------------------------------------------------------------------------------------------
+
+// Scan a run of SoA stationary circles for the first one overlapping a moving circle. findFirst scans rightwards from
+// begin and gives up at the first stationary whose left edge is at or beyond stopX, findLast scans leftwards from
+// end - 1 and gives up at the first stationary whose right edge is at or before stopX. Returns the index of the
+// overlapping stationary or NO_CONTACT.
+// The uniform variants are for stationary circles that all have the same radius and never read rad. They take the contact
+// distance, both radii added, as mrad and test stopX against the centres rather than the edges.
+// Every kernel does the same float operations in the same order as the scalar kernel, so they all pick the same contact
+const uint32_t NO_CONTACT = 0xFFFFFFFF;
+
+typedef uint32_t (*FindContactFn)(const float* x, const float* y, const float* rad, uint32_t begin, uint32_t end, float mx, float my, float mrad, float stopX);
+
+struct NarrowPhaseKernel
+{
+    SimdLevel level;
+    const char* name;
+    FindContactFn findFirst;
+    FindContactFn findLast;
+    FindContactFn findFirstUniform;
+    FindContactFn findLastUniform;
+};
+
+//Squared distance against squared contact distance, no sqrt needed
+inline bool CirclesOverlap(float dx, float dy, float radsum)
+{
+    return (dx * dx) + (dy * dy) < radsum * radsum;
+}
+
+//Same test against a squared contact distance worked out up front
+inline bool UniformCirclesOverlap(float dx, float dy, float contact)
+{
+    return (dx * dx) + (dy * dy) < contact;
+}
+
+//Highest instruction set the CPU and OS both support
+SimdLevel DetectSimdLevel();
+
+//Picks the widest kernel supported at runtime, capped by maxLevel
+NarrowPhaseKernel SelectNarrowPhaseKernel(SimdLevel maxLevel);
+
+//Kernel used by the collision functions, scalar until SelectNarrowPhaseKernel's result is stored here
+extern NarrowPhaseKernel narrowPhase;
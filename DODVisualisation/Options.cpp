@@ -0,0 +1,240 @@
+// Options.cpp: Scenario options read at startup by the visualiser and the headless runner
+
+#include "Options.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+
+static bool ParseInt(const std::string& text, int& value)
+{
+    char* end;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0')
+    {
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+static bool ParseUnsigned(const std::string& text, uint32_t& value)
+{
+    char* end;
+    unsigned long parsed = std::strtoul(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || text[0] == '-')
+    {
+        return false;
+    }
+    value = static_cast<uint32_t>(parsed);
+    return true;
+}
+
+static bool ParseFloat(const std::string& text, float& value)
+{
+    char* end;
+    value = std::strtof(text.c_str(), &end);
+    return !text.empty() && *end == '\0';
+}
+
+static bool ParseBool(const std::string& text, bool& value)
+{
+    if (text == "on" || text == "true" || text == "1")
+    {
+        value = true;
+    }
+    else if (text == "off" || text == "false" || text == "0")
+    {
+        value = false;
+    }
+    else return false;
+    return true;
+}
+
+static std::string Trim(const std::string& text)
+{
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+    {
+        return std::string();
+    }
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+OptionError SetOption(SimulationOptions& options, const std::string& name, const std::string& value)
+{
+    bool valid;
+    if (name == "circles")                valid = ParseUnsigned(value, options.circles);
+    else if (name == "min-x")             valid = ParseInt(value, options.minX);
+    else if (name == "max-x")             valid = ParseInt(value, options.maxX);
+    else if (name == "min-y")             valid = ParseInt(value, options.minY);
+    else if (name == "max-y")             valid = ParseInt(value, options.maxY);
+    else if (name == "fixed-timestep")    valid = ParseFloat(value, options.fixedTimestep) && options.fixedTimestep >= 0.0f;
+    else if (name == "death")             valid = ParseBool(value, options.death);
+    else if (name == "walls")             valid = ParseBool(value, options.walls);
+    else if (name == "moving-collisions") valid = ParseBool(value, options.movingCollisions);
+    else if (name == "pipeline")          valid = ParseBool(value, options.pipeline);
+    else if (name == "huge-pages")        valid = ParseBool(value, options.hugePages);
+    else if (name == "pin-threads")       valid = ParseBool(value, options.pinThreads);
+    else if (name == "reorder-interval")  valid = ParseUnsigned(value, options.reorderInterval);
+    else if (name == "rand-radius")       valid = ParseBool(value, options.randRadius);
+    else if (name == "min-radius")        valid = ParseInt(value, options.minRadius);
+    else if (name == "max-radius")        valid = ParseInt(value, options.maxRadius);
+    else if (name == "radius")            valid = ParseFloat(value, options.radius);
+    else if (name == "broad-phase")
+    {
+        valid = true;
+        if (value == "sweep")      options.broadPhase = BroadPhase::Sweep;
+        else if (value == "grid")  options.broadPhase = BroadPhase::Grid;
+        else valid = false;
+    }
+    else if (name == "max-simd")
+    {
+        valid = true;
+        if (value == "scalar")       options.maxSimd = SimdLevel::Scalar;
+        else if (value == "sse4.1")  options.maxSimd = SimdLevel::SSE41;
+        else if (value == "avx2")    options.maxSimd = SimdLevel::AVX2;
+        else if (value == "avx512")  options.maxSimd = SimdLevel::AVX512;
+        else valid = false;
+    }
+    else if (name == "log")
+    {
+        valid = true;
+        if (value == "none")         options.collisionLog = CollisionLogFormat::None;
+        else if (value == "text")    options.collisionLog = CollisionLogFormat::Text;
+        else if (value == "binary")  options.collisionLog = CollisionLogFormat::Binary;
+        else valid = false;
+    }
+    else if (name == "snapshot")
+    {
+        options.snapshot = value;
+        valid = !value.empty();
+    }
+    else if (name == "trajectory")
+    {
+        options.trajectory = value;
+        valid = !value.empty();
+    }
+    else if (name == "replay")
+    {
+        options.replay = value;
+        valid = !value.empty();
+    }
+    else if (name == "profile-trace")
+    {
+        options.profileTrace = value;
+        valid = !value.empty();
+    }
+    else if (name == "profile-summary")
+    {
+        options.profileSummary = value;
+        valid = !value.empty();
+    }
+    else if (name == "log-file")
+    {
+        options.collisionLogFile = value;
+        valid = !value.empty();
+    }
+    else return OptionError::UnknownName;
+
+    return valid ? OptionError::None : OptionError::BadValue;
+}
+
+bool LoadOptions(SimulationOptions& options, const char* path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); ++lineNumber)
+    {
+        line = Trim(line.substr(0, line.find('#')));
+        if (line.empty())
+        {
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos)
+        {
+            std::cout << path << "(" << lineNumber << "): Expected name = value" << std::endl;
+            return false;
+        }
+
+        std::string name = Trim(line.substr(0, equals));
+        std::string value = Trim(line.substr(equals + 1));
+        OptionError error = SetOption(options, name, value);
+        if (error == OptionError::UnknownName)
+        {
+            std::cout << path << "(" << lineNumber << "): Unknown option " << name << std::endl;
+            return false;
+        }
+        if (error == OptionError::BadValue)
+        {
+            std::cout << path << "(" << lineNumber << "): Invalid value for " << name << ": " << value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ValidateOptions(const SimulationOptions& options)
+{
+    if (options.circles < 2)
+    {
+        std::cout << "Need at least 2 circles" << std::endl;
+        return false;
+    }
+    if (options.circles > MAX_CIRCLES)
+    {
+        std::cout << "At most " << MAX_CIRCLES << " circles are supported" << std::endl;
+        return false;
+    }
+    if (options.reorderInterval > 0 && options.movingCollisions)
+    {
+        std::cout << "reorder-interval needs moving-collisions off, the pair sweep keeps the moving circles x-sorted" << std::endl;
+        return false;
+    }
+    if (options.minX >= options.maxX || options.minY >= options.maxY)
+    {
+        std::cout << "World bounds are empty" << std::endl;
+        return false;
+    }
+    if (options.randRadius ? options.minRadius < 1 || options.minRadius > options.maxRadius : !(options.radius > 0.0f))
+    {
+        std::cout << "Circle radius must be positive" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void PrintOptions(std::ostream& out)
+{
+    SimulationOptions defaults;
+    out << "  circles N                  Number of circles, half moving and half stationary (default " << defaults.circles << ")\n"
+        << "  min-x, max-x, min-y, max-y Bounds circles are generated in (default " << MIN_X << " to " << MAX_X << ")\n"
+        << "  fixed-timestep S           Seconds per simulation step, 0 steps by frame time (default 0)\n"
+        << "  death on|off               Remove circles whose hp runs out (default off)\n"
+        << "  walls on|off               Bounce off walls a tenth outside the bounds (default on)\n"
+        << "  moving-collisions on|off   Collide moving circles with each other (default on)\n"
+        << "  rand-radius on|off         Random radius, otherwise every circle has radius (default on)\n"
+        << "  min-radius, max-radius N   Random radius range (default " << MIN_RAD << " to " << MAX_RAD << ")\n"
+        << "  radius R                   Radius of every circle when rand-radius is off (default " << defaults.radius << ")\n"
+        << "  broad-phase sweep|grid     Broad phase against the stationary circles (default sweep)\n"
+        << "  max-simd scalar|sse4.1|avx2|avx512  Widest narrow phase kernel to use (default avx512)\n"
+        << "  pipeline on|off            Step the next frame while this one is drawn, off for lockstep (default on)\n"
+        << "  huge-pages on|off          Back the largest arrays with huge pages where the OS allows (default off)\n"
+        << "  pin-threads on|off         Pin each worker thread to its own core where the OS allows (default off)\n"
+        << "  reorder-interval N         Steps between Morton sorts of the moving circles, needs moving-collisions off (default 0, never)\n"
+        << "  snapshot PATH              Load the world from a snapshot, its scenario options replace these (default none)\n"
+        << "  trajectory PATH            Record moving circle positions every frame to PATH (default none)\n"
+        << "  replay PATH                Play back a recorded trajectory rather than simulating (default none)\n"
+        << "  profile-trace PATH         Write per-thread phase timings as a Chrome trace when done (default none)\n"
+        << "  profile-summary PATH       Write per-frame phase timings and counters as CSV when done (default none)\n"
+        << "  log none|text|binary       Collision log (default text)\n"
+        << "  log-file PATH              File the binary log is written to (default " << defaults.collisionLogFile << ")\n";
+}
@@ -0,0 +1,133 @@
+// Options.h: Scenario options read at startup by the visualiser and the headless runner
+#pragma once
+
+#include "NarrowPhase.h"
+#include "CollisionLog.h"
+#include <cstdint>
+#include <string>
+#include <iosfwd>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Defaults
+//---------------------------------------------------------------------------------------------------------------------
+const int CIRCLE_NUM = 25000; //Default number of circles, half moving and half stationary
+
+//Most circles a world can have. Circle indices and ids are 32 bit, which halves the index traffic of 64 bit ones, and
+//below this a ParallelFor's chunk arithmetic and a trajectory keyframe's size can't overflow either. Byte sizes are 64 bit
+const uint32_t MAX_CIRCLES = 1u << 29;
+
+const int MAX_X = 1000;
+const int MAX_Y = 1000;
+const int MIN_X = -1000;
+const int MIN_Y = -1000;
+
+const int MAXVEL_X = 50;
+const int MAXVEL_Y = 50;
+const int MINVEL_X = -50;
+const int MINVEL_Y = -50;
+
+const int MAX_RAD = 5;
+const int MIN_RAD = 1;
+
+//Most fixed steps one StepSimulation runs, past this the simulation runs slow rather than falling further behind
+const uint32_t MAX_FIXED_STEPS = 8;
+
+//Config file the visualiser reads its options from, if it exists
+const char* const OPTIONS_FILE = "DODVisualisation.cfg";
+
+//---------------------------------------------------------------------------------------------------------------------
+// Options
+//---------------------------------------------------------------------------------------------------------------------
+
+//Broad phase used to find stationary circles near each moving circle
+enum class BroadPhase
+{
+    Sweep, //Binary search the x-sorted stationary array then walk the x-strip
+    Grid   //Uniform grid over the stationary set, test the 3x3 cells around the moving circle
+};
+
+// Everything that picks a scenario. The flags choose which specialisation of the per-frame kernels is run, so they are
+// read once at startup and a disabled feature costs nothing per circle
+struct SimulationOptions
+{
+    uint32_t circles = CIRCLE_NUM;
+
+    //Circles are generated inside these bounds, the walls are a tenth further out
+    int minX = MIN_X;
+    int maxX = MAX_X;
+    int minY = MIN_Y;
+    int maxY = MAX_Y;
+
+    //Seconds per simulation step, 0 steps by each frame's time. Fixed steps give the same results at any frame rate
+    float fixedTimestep = 0.0f;
+
+    bool death = false;
+    bool walls = true;
+    bool movingCollisions = true;
+
+    //Random radius between minRadius and maxRadius, otherwise every circle has radius
+    bool randRadius = true;
+    int minRadius = MIN_RAD;
+    int maxRadius = MAX_RAD;
+    float radius = 1.0f;
+
+    BroadPhase broadPhase = BroadPhase::Sweep;
+
+    //Steps between sorts of the moving circles along a Morton curve, 0 for never. Only with moving collisions off, as
+    //those keep the moving circles x-sorted for the pair sweep instead
+    uint32_t reorderInterval = 0;
+
+    //Widest instruction set the narrow phase may use, the widest one the CPU supports up to this is picked at startup
+    SimdLevel maxSimd = SimdLevel::AVX512;
+
+    //Step the simulation on its own thread while the previous step is drawn, otherwise each step is drawn once it is done
+    bool pipeline = true;
+
+    //Back the largest arrays with huge pages, for worlds of millions of circles where TLB misses start to show
+    bool hugePages = false;
+
+    //Pin each worker thread to a core of its own, so the OS doesn't move a worker away from the cache it warmed up
+    bool pinThreads = false;
+
+    //Snapshot to load the world from in place of generating one, empty to generate
+    std::string snapshot;
+
+    //Trajectory moving circle positions are recorded to, empty for none
+    std::string trajectory;
+
+    //Trajectory to play back in place of running the simulation, empty to simulate
+    std::string replay;
+
+    //Chrome trace and per-frame CSV the hot path timers and counters are written to, empty for none. Both empty records nothing
+    std::string profileTrace;
+    std::string profileSummary;
+
+    //Where collision events go when not visualising
+    CollisionLogFormat collisionLog = CollisionLogFormat::Text;
+    std::string collisionLogFile = "collisions.bin";
+};
+
+//Largest radius any circle can have, which sizes the broad phase strips and grid cells
+inline float MaxRadius(const SimulationOptions& options)
+{
+    return options.randRadius ? static_cast<float>(options.maxRadius) : options.radius;
+}
+
+enum class OptionError
+{
+    None,
+    UnknownName,
+    BadValue
+};
+
+//Sets the option called name, e.g. "walls", from its text value, e.g. "off"
+OptionError SetOption(SimulationOptions& options, const std::string& name, const std::string& value);
+
+//Reads "name = value" lines, '#' starts a comment. Returns false, after saying why, if the file can't be read or has a bad line
+bool LoadOptions(SimulationOptions& options, const char* path);
+
+//Returns false, after saying why, if the options can't make a world
+bool ValidateOptions(const SimulationOptions& options);
+
+//Lists every option name, its values and its default
+void PrintOptions(std::ostream& out);
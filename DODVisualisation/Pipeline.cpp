@@ -0,0 +1,162 @@
+// Pipeline.cpp: Steps the simulation on its own thread while the caller renders the previous step
+
+#include "Pipeline.h"
+#include "Profile.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//Copies what a renderer needs from the world into frame and marks the circles that have moved since they were last sent
+static void PublishFrame(SimulationPipeline& pipeline, FrameState& frame)
+{
+    PROFILE_SCOPE(PROFILE_PUBLISH);
+    const World& world = *pipeline.world;
+    frame.numMoving = world.numMoving;
+    frame.movingCircles.assign(world.movingCircles.begin(), world.movingCircles.begin() + world.numMoving);
+    frame.movingIds.assign(world.movingIds.begin(), world.movingIds.begin() + world.numMoving);
+    frame.changed.resize((world.numMoving + 63) / 64);
+
+    // Chunks are whole words of the mask, so the threads never share one
+    const Circle* moving = frame.movingCircles.data();
+    const uint32_t* movingId = frame.movingIds.data();
+    float* sentX = pipeline.sentX.data();
+    float* sentY = pipeline.sentY.data();
+    uint64_t* changed = frame.changed.data();
+    ParallelFor(0, world.numMoving, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        for (uint32_t word = chunkBegin / 64; word * 64 < chunkEnd; ++word)
+        {
+            uint64_t bits = 0;
+            uint32_t wordEnd = std::min(word * 64 + 64, chunkEnd);
+            for (uint32_t i = word * 64; i < wordEnd; ++i)
+            {
+                uint32_t id = movingId[i];
+                // Written so a NaN, as at the start, counts as moved
+                if (!(std::abs(moving[i].x - sentX[id]) <= MOVE_EPSILON && std::abs(moving[i].y - sentY[id]) <= MOVE_EPSILON))
+                {
+                    bits |= 1ull << (i - word * 64);
+                    sentX[id] = moving[i].x;
+                    sentY[id] = moving[i].y;
+                }
+            }
+            changed[word] = bits;
+        }
+    });
+
+    frame.numStationaryIds = static_cast<uint32_t>(world.stationaryIndex.size());
+
+    frame.removedMoving = world.removedMoving;
+    frame.removedStationary = world.removedStationary;
+    frame.insertedStationary = world.insertedStationary;
+
+    // The stationary arrays are rebuilt by the next step's updates, so inserted circles are copied now
+    frame.insertedCircles.clear();
+    for (uint32_t id : world.insertedStationary)
+    {
+        frame.insertedCircles.push_back(world.stationaryCircles[world.stationaryIndex[id]]);
+    }
+}
+
+//*********************************************************
+// The simulation thread runs this method
+// It waits for LaunchStep, advances the world into the back frame, then signals it is done. Only this thread calls
+// ParallelFor while the pipeline runs, so it works alongside the workers as thread 0
+static void PipelineThread(SimulationPipeline* pipeline)
+{
+    PROFILE_ONLY(ProfileThreadName("Simulation");)
+    while (true)
+    {
+        float frameTime;
+        {
+            std::unique_lock<std::mutex> l(pipeline->lock);
+            pipeline->stepReady.wait(l, [&]() { return pipeline->stepping || pipeline->stopping; });
+            if (pipeline->stopping)
+            {
+                return;
+            }
+            frameTime = pipeline->frameTime;
+        }
+
+        AdvanceWorld(*pipeline->world, frameTime);
+        PublishFrame(*pipeline, pipeline->frames[pipeline->front ^ 1]);
+
+        {
+            std::unique_lock<std::mutex> l(pipeline->lock);
+            pipeline->stepping = false;
+        }
+        pipeline->stepDone.notify_one();
+    }
+}
+
+void StartPipeline(SimulationPipeline& pipeline, World& world, bool lockstep)
+{
+    pipeline.world = &world;
+    pipeline.lockstep = lockstep;
+    pipeline.front = 0;
+    pipeline.stepping = false;
+    pipeline.inFlight = false;
+    pipeline.stopping = false;
+
+    // Moving ids are never added to, and every one has a name, dead or alive
+    pipeline.sentX.assign(world.movingNames.size(), std::numeric_limits<float>::quiet_NaN());
+    pipeline.sentY.assign(world.movingNames.size(), std::numeric_limits<float>::quiet_NaN());
+    PublishFrame(pipeline, pipeline.frames[0]);
+
+    if (!lockstep)
+    {
+        pipeline.thread = std::thread(&PipelineThread, &pipeline);
+    }
+}
+
+void FinishStep(SimulationPipeline& pipeline)
+{
+    if (!pipeline.inFlight)
+    {
+        return;
+    }
+
+    {
+        PROFILE_SCOPE(PROFILE_STEP_WAIT);
+        std::unique_lock<std::mutex> l(pipeline.lock);
+        pipeline.stepDone.wait(l, [&]() { return !pipeline.stepping; });
+    }
+    pipeline.front ^= 1;
+    pipeline.inFlight = false;
+}
+
+void LaunchStep(SimulationPipeline& pipeline, float frameTime)
+{
+    if (pipeline.lockstep)
+    {
+        StepSimulation(*pipeline.world, frameTime);
+        PublishFrame(pipeline, pipeline.frames[pipeline.front]);
+        return;
+    }
+
+    FinishStep(pipeline); // Only one step in flight, so the front frame is never written while it is drawn
+
+    // Stationary updates are applied here rather than on the simulation thread, so the stationary circles can be queried
+    // while the step is in flight
+    BeginStep(*pipeline.world);
+    {
+        std::unique_lock<std::mutex> l(pipeline.lock);
+        pipeline.frameTime = frameTime;
+        pipeline.stepping = true;
+    }
+    pipeline.inFlight = true;
+    pipeline.stepReady.notify_one();
+}
+
+void StopPipeline(SimulationPipeline& pipeline)
+{
+    FinishStep(pipeline);
+    if (pipeline.thread.joinable())
+    {
+        {
+            std::unique_lock<std::mutex> l(pipeline.lock);
+            pipeline.stopping = true;
+        }
+        pipeline.stepReady.notify_one();
+        pipeline.thread.join();
+    }
+}
@@ -0,0 +1,90 @@
+// Pipeline.h: Steps the simulation on its own thread while the caller renders the previous step
+#pragma once
+
+#include "Simulation.h"
+#include <thread>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Frame State
+//---------------------------------------------------------------------------------------------------------------------
+
+//Distance in x or y a moving circle must move before it is sent to the render sink again
+const float MOVE_EPSILON = 0.01f;
+
+// The change mask is built a chunk at a time, so each chunk must cover whole 64 bit words
+static_assert(CHUNK_SIZE % 64 == 0, "Change mask words would be shared between chunks");
+
+// What a renderer needs from one finished step, copied out of the world so it can be read while the next step runs.
+// The change lists are the world's for that step, so every removal and insert is seen by exactly one frame
+struct FrameState
+{
+    uint32_t numMoving = 0;
+    std::vector<Circle> movingCircles;
+    std::vector<uint32_t> movingIds;
+    std::vector<uint64_t> changed; //Bit i is set when movingCircles[i] has moved more than MOVE_EPSILON since last sent
+
+    uint32_t numStationaryIds = 0; //Stationary ids handed out so far, sizes anything indexed by stationary id
+
+    std::vector<uint32_t> removedMoving;
+    std::vector<uint32_t> removedStationary;
+    std::vector<uint32_t> insertedStationary;
+    std::vector<Circle> insertedCircles; //Parallel to insertedStationary
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Pipeline
+//---------------------------------------------------------------------------------------------------------------------
+
+// Pipelined, step N + 1 runs on a simulation thread, which drives the scheduler's workers, while the caller draws step N
+// from the front FrameState. The step writes the back FrameState and the two swap when it is waited for, so what is drawn
+// is never more than one step behind. In lockstep each step runs on the calling thread and is drawn straight after, for
+// runs that have to line up frame for frame with what is drawn
+struct SimulationPipeline
+{
+    World* world = nullptr;
+    bool lockstep = false;
+
+    FrameState frames[2];
+    uint32_t front = 0;
+
+    //Position each moving circle was at when its change bit was last set, by id
+    std::vector<float> sentX;
+    std::vector<float> sentY;
+
+    // The simulation thread sleeps on stepReady until stepping is set, the caller sleeps on stepDone until it is cleared.
+    // A mutex is used to guard these
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable stepReady;
+    std::condition_variable stepDone;
+    float frameTime = 0.0f;
+    bool stepping = false;
+    bool inFlight = false; //A step was started that FinishStep has not waited for yet
+    bool stopping = false;
+};
+
+//Publishes the world's current state as the first frame, with every circle marked changed, and unless lockstep starts the
+//simulation thread. Call after PrepareWorld, from the thread that will call the other pipeline functions, which is then
+//the only one using the scheduler
+void StartPipeline(SimulationPipeline& pipeline, World& world, bool lockstep);
+
+//Waits for the step in flight and makes it the front frame. Until LaunchStep the world can be read and changed, e.g. to
+//queue stationary updates
+void FinishStep(SimulationPipeline& pipeline);
+
+//Steps the world by frameTime. Pipelined this applies the queued stationary updates, then returns at once and the world
+//must be left alone until FinishStep, apart from querying the stationary circles, which don't change until the next
+//LaunchStep. In lockstep it returns once the step is done and the front frame shows it
+void LaunchStep(SimulationPipeline& pipeline, float frameTime);
+
+//The frame to draw, unchanged until the next FinishStep or, in lockstep, LaunchStep
+inline const FrameState& FrontFrame(const SimulationPipeline& pipeline)
+{
+    return pipeline.frames[pipeline.front];
+}
+
+//Waits for the step in flight and joins the simulation thread
+void StopPipeline(SimulationPipeline& pipeline);
@@ -0,0 +1,313 @@
+// Profile.cpp: Per-thread timers and counters for the hot path, exported as a Chrome trace and a per-frame CSV
+
+#include "Profile.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+Profiler profiler;
+
+static const char* const PROFILE_NAMES[NUM_PROFILE_IDS] =
+{
+    "step", "stationary_updates", "collide", "resolve_contacts", "stationary_hits", "walls", "resort", "reorder", "moving_pairs",
+    "resolve_pairs", "death", "publish", "model_updates", "wait", "step_wait",
+    "search_steps", "narrow_calls", "candidates", "contacts", "moving_pairs_found", "chunks_stolen", "cas_retries"
+};
+
+//The calling thread's buffer, handed out the first time it records
+static thread_local ProfileBuffer* profileBuffer = nullptr;
+
+static uint64_t SteadyNanoseconds()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void StartProfiler(uint32_t eventsPerThread)
+{
+    profiler.eventsPerThread = eventsPerThread;
+    profiler.startTime = SteadyNanoseconds();
+    profiler.frame.store(0);
+    profiler.enabled = true;
+}
+
+//Returns null once every buffer is handed out
+static ProfileBuffer* ThreadBuffer()
+{
+    if (!profileBuffer)
+    {
+        uint32_t thread = profiler.numThreads.fetch_add(1);
+        if (thread >= MAX_PROFILE_THREADS)
+        {
+            return nullptr;
+        }
+        profileBuffer = &profiler.threads[thread];
+        profileBuffer->events.resize(profiler.eventsPerThread);
+    }
+    return profileBuffer;
+}
+
+void ProfileThreadName(const char* name)
+{
+    if (profiler.enabled)
+    {
+        if (ProfileBuffer* buffer = ThreadBuffer())
+        {
+            buffer->name = name;
+        }
+    }
+}
+
+uint64_t ProfileTime()
+{
+    return SteadyNanoseconds() - profiler.startTime;
+}
+
+static void AppendEvent(ProfileBuffer& buffer, ProfileId id, uint64_t start, uint64_t end, uint32_t frame, uint64_t value)
+{
+    if (buffer.numEvents == buffer.events.size())
+    {
+        ++buffer.dropped;
+        return;
+    }
+
+    ProfileEvent& event = buffer.events[buffer.numEvents++];
+    event.start = start;
+    event.duration = static_cast<uint32_t>(end - start);
+    event.frame = frame;
+    event.value = static_cast<uint32_t>(std::min<uint64_t>(value, UINT32_MAX));
+    event.id = id;
+}
+
+//Turns the counts summed for the buffer's frame into events
+static void FlushCounts(ProfileBuffer& buffer)
+{
+    for (uint32_t counter = 0; counter < NUM_PROFILE_COUNTERS; ++counter)
+    {
+        if (buffer.counts[counter] > 0)
+        {
+            AppendEvent(buffer, static_cast<ProfileId>(NUM_PROFILE_PHASES + counter), 0, 0, buffer.countFrame, buffer.counts[counter]);
+            buffer.counts[counter] = 0;
+        }
+    }
+}
+
+void RecordProfileEvent(ProfileId id, uint64_t start, uint64_t end, uint32_t value)
+{
+    ProfileBuffer* buffer = ThreadBuffer();
+    if (!buffer)
+    {
+        return;
+    }
+
+    uint32_t frame = profiler.frame.load(std::memory_order_relaxed);
+    if (id < NUM_PROFILE_PHASES)
+    {
+        AppendEvent(*buffer, id, start, end, frame, value);
+        return;
+    }
+    if (frame != buffer->countFrame)
+    {
+        FlushCounts(*buffer);
+        buffer->countFrame = frame;
+    }
+    buffer->counts[id - NUM_PROFILE_PHASES] += value;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Export
+//---------------------------------------------------------------------------------------------------------------------
+
+//Also flushes each thread's last frame of counts, which is why the threads must have stopped
+static uint32_t NumProfileThreads()
+{
+    uint32_t numThreads = std::min(profiler.numThreads.load(), MAX_PROFILE_THREADS);
+    for (uint32_t thread = 0; thread < numThreads; ++thread)
+    {
+        FlushCounts(profiler.threads[thread]);
+    }
+    return numThreads;
+}
+
+//Says how many events didn't fit, so a short trace isn't mistaken for a quiet one
+static void ReportDropped()
+{
+    uint64_t dropped = 0;
+    uint32_t numThreads = std::min(profiler.numThreads.load(), MAX_PROFILE_THREADS);
+    for (uint32_t thread = 0; thread < numThreads; ++thread)
+    {
+        dropped += profiler.threads[thread].dropped;
+    }
+    if (dropped > 0)
+    {
+        std::cout << "Profile events dropped: " << dropped << std::endl;
+    }
+}
+
+bool WriteProfileTrace(const char* path)
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+
+    // Timestamps are in microseconds, kept to nanoseconds with three decimals
+    out << "{\"traceEvents\":[\n";
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    const char* separator = "";
+    uint32_t numThreads = NumProfileThreads();
+    for (uint32_t thread = 0; thread < numThreads; ++thread)
+    {
+        const ProfileBuffer& buffer = profiler.threads[thread];
+        out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread << ",\"args\":{\"name\":\"" << buffer.name << " " << thread << "\"}}";
+        separator = ",\n";
+
+        for (uint32_t i = 0; i < buffer.numEvents; ++i)
+        {
+            const ProfileEvent& event = buffer.events[i];
+            if (event.id < NUM_PROFILE_PHASES)
+            {
+                out << separator << "{\"name\":\"" << PROFILE_NAMES[event.id] << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread
+                    << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << ",\"args\":{\"frame\":" << event.frame << "}}";
+            }
+        }
+    }
+
+    // Counters are summed over the threads per frame and drawn at the frame's first event
+    std::vector<uint64_t> frameStart;
+    std::vector<uint64_t> counts;
+    const uint32_t numCounters = NUM_PROFILE_COUNTERS;
+    for (uint32_t thread = 0; thread < numThreads; ++thread)
+    {
+        const ProfileBuffer& buffer = profiler.threads[thread];
+        for (uint32_t i = 0; i < buffer.numEvents; ++i)
+        {
+            const ProfileEvent& event = buffer.events[i];
+            if (event.frame >= frameStart.size())
+            {
+                frameStart.resize(event.frame + 1, UINT64_MAX);
+                counts.resize(frameStart.size() * numCounters, 0);
+            }
+            if (event.id < NUM_PROFILE_PHASES)
+            {
+                frameStart[event.frame] = std::min(frameStart[event.frame], event.start);
+            }
+            else
+            {
+                counts[event.frame * numCounters + event.id - NUM_PROFILE_PHASES] += event.value;
+            }
+        }
+    }
+    for (uint32_t frame = 0; frame < frameStart.size(); ++frame)
+    {
+        if (frameStart[frame] == UINT64_MAX)
+        {
+            continue;
+        }
+        out << separator << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":0,\"ts\":" << frameStart[frame] / 1000.0 << ",\"args\":{";
+        for (uint32_t counter = 0; counter < numCounters; ++counter)
+        {
+            out << (counter > 0 ? "," : "") << "\"" << PROFILE_NAMES[NUM_PROFILE_PHASES + counter] << "\":" << counts[frame * numCounters + counter];
+        }
+        out << "}}";
+    }
+    out << "\n]}\n";
+
+    ReportDropped();
+    if (!out)
+    {
+        std::cout << "Could not write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool WriteProfileSummary(const char* path)
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+
+    // Per frame: nanoseconds per phase, counts per counter, then wait nanoseconds per thread
+    uint32_t numThreads = NumProfileThreads();
+    uint32_t numColumns = NUM_PROFILE_IDS + numThreads;
+    std::vector<uint64_t> rows;
+    for (uint32_t thread = 0; thread < numThreads; ++thread)
+    {
+        const ProfileBuffer& buffer = profiler.threads[thread];
+        for (uint32_t i = 0; i < buffer.numEvents; ++i)
+        {
+            const ProfileEvent& event = buffer.events[i];
+            if ((event.frame + 1ull) * numColumns > rows.size())
+            {
+                rows.resize((event.frame + 1ull) * numColumns, 0);
+            }
+            uint64_t* row = rows.data() + event.frame * numColumns;
+            if (event.id < NUM_PROFILE_PHASES)
+            {
+                row[event.id] += event.duration;
+                if (event.id == PROFILE_WAIT)
+                {
+                    row[NUM_PROFILE_IDS + thread] += event.duration;
+                }
+            }
+            else
+            {
+                row[event.id] += event.value;
+            }
+        }
+    }
+
+    out << "frame";
+    for (uint32_t id = 0; id < NUM_PROFILE_IDS; ++id)
+    {
+        out << "," << PROFILE_NAMES[id] << (id < NUM_PROFILE_PHASES ? "_us" : "");
+    }
+    for (uint32_t thread = 0; thread < numThreads; ++thread)
+    {
+        std::string name = profiler.threads[thread].name;
+        for (char& c : name)
+        {
+            c = c == ' ' ? '_' : static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        out << ",wait_" << name << "_" << thread << "_us";
+    }
+    out << "\n";
+
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    for (uint32_t frame = 0; frame * numColumns < rows.size(); ++frame)
+    {
+        const uint64_t* row = rows.data() + frame * numColumns;
+        out << frame;
+        for (uint32_t column = 0; column < numColumns; ++column)
+        {
+            bool time = column < NUM_PROFILE_PHASES || column >= NUM_PROFILE_IDS;
+            if (time)
+            {
+                out << "," << row[column] / 1000.0;
+            }
+            else
+            {
+                out << "," << row[column];
+            }
+        }
+        out << "\n";
+    }
+
+    ReportDropped();
+    if (!out)
+    {
+        std::cout << "Could not write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,164 @@
+// Profile.h: Per-thread timers and counters for the hot path, exported as a Chrome trace and a per-frame CSV
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Profile Points
+//---------------------------------------------------------------------------------------------------------------------
+
+// Built with DOD_PROFILE defined to 0 every PROFILE_ macro is empty and nothing here is called, so there is no cost at
+// all. Built with it, the default, recording only happens between StartProfiler and the exports, and otherwise costs a
+// flag test per scope. Scopes are placed per chunk or per phase rather than per circle, so even recording the timer is
+// read a few hundred times a frame. Per circle work, like binary search steps and narrow phase calls, is counted into
+// locals and added once per chunk
+
+#ifndef DOD_PROFILE
+#define DOD_PROFILE 1
+#endif
+
+//Timed phases, then counters. The names are the CSV column names
+enum ProfileId : uint16_t
+{
+    PROFILE_STEP,               //One AdvanceWorld, fixed steps included
+    PROFILE_STATIONARY_UPDATES, //Removals and the merge of inserts
+    PROFILE_COLLIDE,            //Broad phase and narrow phase against the stationary circles, per chunk
+    PROFILE_RESOLVE_CONTACTS,   //Integration and stationary impacts, per chunk
+    PROFILE_STATIONARY_HITS,    //Reducing the threads' stationary hits into the hp, or the events one at a time
+    PROFILE_WALLS,              //Wall bounces, per chunk
+    PROFILE_RESORT,             //Insertion sort of the moving circles on x
+    PROFILE_REORDER,            //Sort of the moving circles along a Morton curve
+    PROFILE_MOVING_PAIRS,       //Sweep for overlapping moving circles, per chunk
+    PROFILE_RESOLVE_PAIRS,      //Resolving them, colour by colour
+    PROFILE_DEATH,              //Counting and removing dead circles
+    PROFILE_PUBLISH,            //Copying a finished step out for the renderer
+    PROFILE_MODEL_UPDATES,      //Sending moved circles to the render sink and adding or removing models
+    PROFILE_WAIT,               //A worker waiting for a ParallelFor, or the caller waiting for the workers to finish one
+    PROFILE_STEP_WAIT,          //Waiting in FinishStep for the pipelined step
+    NUM_PROFILE_PHASES,
+
+    PROFILE_SEARCH_STEPS = NUM_PROFILE_PHASES, //Binary search steps into the stationary circles
+    PROFILE_NARROW_CALLS,       //Narrow phase kernel calls, each a SIMD scan of a run of stationary circles
+    PROFILE_CANDIDATES,         //Stationary circles the narrow phase found touching a move, each given a time of impact
+    PROFILE_CONTACTS,           //Impacts resolved, stationary and moving
+    PROFILE_MOVING_PAIRS_FOUND, //Overlapping moving pairs
+    PROFILE_CHUNKS_STOLEN,      //Chunks a thread took from another thread's run
+    PROFILE_CAS_RETRIES,        //Compare-exchanges on a chunk run that lost a race and went round again
+    NUM_PROFILE_IDS
+};
+
+//One timed scope, or with duration 0 one counter addition
+struct ProfileEvent
+{
+    uint64_t start;    //Nanoseconds since StartProfiler
+    uint32_t duration; //Nanoseconds
+    uint32_t frame;
+    uint32_t value;    //Counters only
+    uint16_t id;
+    uint16_t padding;
+};
+
+const uint32_t NUM_PROFILE_COUNTERS = NUM_PROFILE_IDS - NUM_PROFILE_PHASES;
+
+//Events each thread has room for, enough for a few thousand frames at 25k circles
+const uint32_t PROFILE_EVENTS_PER_THREAD = 1 << 20;
+
+// Each thread appends to its own buffer, so recording takes no lock. A buffer is allocated whole the first time its
+// thread records, and once it is full further events are dropped and counted. Counters are summed per frame and only
+// become events when the frame changes, so they cost an addition and not a buffer slot per chunk
+struct ProfileBuffer
+{
+    std::vector<ProfileEvent> events;
+    uint32_t numEvents = 0;
+    uint64_t dropped = 0;
+    const char* name = "Thread";
+
+    uint64_t counts[NUM_PROFILE_COUNTERS] = {};
+    uint32_t countFrame = 0;
+};
+
+//Every thread that ever records: the scheduler's, the pipeline's and the caller's, with room to spare
+const uint32_t MAX_PROFILE_THREADS = 40;
+
+struct Profiler
+{
+    bool enabled = false;
+    uint32_t eventsPerThread = 0;
+    uint64_t startTime = 0;
+    std::atomic<uint32_t> frame{ 0 };      //StepSimulation calls so far, every event is tagged with it
+    std::atomic<uint32_t> numThreads{ 0 }; //Buffers handed out
+    ProfileBuffer threads[MAX_PROFILE_THREADS];
+};
+
+extern Profiler profiler;
+
+//Starts recording, with room for eventsPerThread events on each thread. Call before the threads being profiled start work
+void StartProfiler(uint32_t eventsPerThread);
+
+//Names the calling thread in the exports, e.g. "Worker". Threads never named are "Thread"
+void ProfileThreadName(const char* name);
+
+//Call once per step, from the thread stepping
+inline void ProfileFrame()
+{
+    profiler.frame.fetch_add(1, std::memory_order_relaxed);
+}
+
+//Nanoseconds since StartProfiler
+uint64_t ProfileTime();
+
+void RecordProfileEvent(ProfileId id, uint64_t start, uint64_t end, uint32_t value);
+
+inline void ProfileCount(ProfileId counter, uint32_t value)
+{
+    if (profiler.enabled && value > 0)
+    {
+        RecordProfileEvent(counter, 0, 0, value);
+    }
+}
+
+//Times the rest of the enclosing block, if recording when it started
+struct ProfileScope
+{
+    ProfileId id;
+    bool recording;
+    uint64_t start;
+
+    explicit ProfileScope(ProfileId id) : id(id), recording(profiler.enabled), start(recording ? ProfileTime() : 0) {}
+    ~ProfileScope()
+    {
+        if (recording)
+        {
+            RecordProfileEvent(id, start, ProfileTime(), 0);
+        }
+    }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if DOD_PROFILE
+#define PROFILE_SCOPE(id) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(id)
+#define PROFILE_COUNT(counter, value) ProfileCount(counter, value)
+#define PROFILE_ONLY(code) code
+#else
+#define PROFILE_SCOPE(id)
+#define PROFILE_COUNT(counter, value)
+#define PROFILE_ONLY(code)
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+// Export
+//---------------------------------------------------------------------------------------------------------------------
+
+// Both read every thread's buffer, so call them once the profiled threads have stopped, e.g. after StopScheduler. Each
+// returns false, after saying why, if the file can't be written
+
+//Writes a Chrome trace, for chrome://tracing or Perfetto: a slice per scope on the thread that ran it, and counters per frame
+bool WriteProfileTrace(const char* path);
+
+//Writes one CSV row per frame: each phase's time summed over the threads in microseconds, each counter, then each thread's
+//wait time in microseconds
+bool WriteProfileSummary(const char* path);
@@ -0,0 +1,160 @@
+// Query.cpp: Read-only batch queries over the stationary circles, which can run while the world steps
+
+#include "Query.h"
+#include <algorithm>
+#include <cmath>
+
+StationaryView ViewStationary(const World& world)
+{
+    StationaryView view;
+    view.numStationary = world.numStationary;
+    view.x = world.stationarySoA.x.data();
+    view.y = world.stationarySoA.y.data();
+    view.rad = world.stationarySoA.rad.data();
+    view.ids = world.stationaryIds.data();
+    view.maxRadius = MaxRadius(world.options);
+    return view;
+}
+
+//First stationary circle with its centre at or right of x
+static uint32_t LowerBound(const StationaryView& view, float x)
+{
+    return static_cast<uint32_t>(std::lower_bound(view.x, view.x + view.numStationary, x) - view.x);
+}
+
+//Runs answer(query, ids, thread) for every query, each appending what it found to its chunk's ids, then gathers them by query
+template <typename Answer>
+static void RunQueries(JobScheduler& jobs, uint32_t numQueries, QueryResults& results, Answer&& answer)
+{
+    uint32_t numChunks = (numQueries + QUERY_CHUNK_SIZE - 1) / QUERY_CHUNK_SIZE;
+    if (results.chunkIds.size() < numChunks)
+    {
+        results.chunkIds.resize(numChunks);
+    }
+    results.start.resize(numQueries + 1);
+    results.start[0] = 0;
+
+    // Counts go one place up, then a prefix sum turns them into starts
+    uint32_t* start = results.start.data();
+    ParallelFor(jobs, 0, numQueries, QUERY_CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        std::vector<uint32_t>& ids = results.chunkIds[chunkBegin / QUERY_CHUNK_SIZE];
+        ids.clear();
+        for (uint32_t query = chunkBegin; query < chunkEnd; ++query)
+        {
+            std::size_t before = ids.size();
+            answer(query, ids, thread);
+            start[query + 1] = static_cast<uint32_t>(ids.size() - before);
+        }
+    });
+    for (uint32_t query = 0; query < numQueries; ++query)
+    {
+        start[query + 1] += start[query];
+    }
+
+    results.ids.resize(start[numQueries]);
+    ParallelFor(jobs, 0, numQueries, QUERY_CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        const std::vector<uint32_t>& ids = results.chunkIds[chunkBegin / QUERY_CHUNK_SIZE];
+        std::copy(ids.begin(), ids.end(), results.ids.begin() + start[chunkBegin]);
+    });
+}
+
+void QueryCircles(JobScheduler& jobs, const StationaryView& view, const CircleQuery* queries, uint32_t numQueries, QueryResults& results)
+{
+    const FindContactFn findFirst = narrowPhase.findFirst;
+    RunQueries(jobs, numQueries, results, [&](uint32_t query, std::vector<uint32_t>& ids, uint32_t thread)
+    {
+        // The same strip walk as the collision broad phase: nothing left of the strip reaches the circle, and the kernel
+        // stops at the first circle whose left edge is far enough right that none after it can either
+        const CircleQuery& q = queries[query];
+        float reach = q.rad + view.maxRadius;
+        for (uint32_t i = findFirst(view.x, view.y, view.rad, LowerBound(view, q.x - reach), view.numStationary, q.x, q.y, q.rad, q.x + reach); i != NO_CONTACT;
+            i = findFirst(view.x, view.y, view.rad, i + 1, view.numStationary, q.x, q.y, q.rad, q.x + reach))
+        {
+            ids.push_back(view.ids[i]);
+        }
+    });
+}
+
+void QueryBoxes(JobScheduler& jobs, const StationaryView& view, const BoxQuery* queries, uint32_t numQueries, QueryResults& results)
+{
+    RunQueries(jobs, numQueries, results, [&](uint32_t query, std::vector<uint32_t>& ids, uint32_t thread)
+    {
+        const BoxQuery& q = queries[query];
+        float stopX = q.maxX + view.maxRadius;
+        for (uint32_t i = LowerBound(view, q.minX - view.maxRadius); i < view.numStationary && view.x[i] <= stopX; ++i)
+        {
+            // Distance from the centre to the nearest point of the box, tombstones fail the test on their NaN y
+            float dx = std::max(std::max(q.minX - view.x[i], view.x[i] - q.maxX), 0.0f);
+            float dy = std::max(std::max(q.minY - view.y[i], view.y[i] - q.maxY), 0.0f);
+            if (view.y[i] == view.y[i] && (dx * dx) + (dy * dy) < view.rad[i] * view.rad[i])
+            {
+                ids.push_back(view.ids[i]);
+            }
+        }
+    });
+}
+
+//A circle kept by a nearest query, ordered by distance then x-order
+struct NearCircle
+{
+    float distance;
+    uint32_t index;
+
+    bool operator<(const NearCircle& other) const
+    {
+        return distance != other.distance ? distance < other.distance : index < other.index;
+    }
+};
+
+void QueryNearest(JobScheduler& jobs, const StationaryView& view, const PointQuery* queries, uint32_t numQueries, uint32_t k, QueryResults& results)
+{
+    // Each thread's heap, so one allocation serves all its queries
+    std::vector<NearCircle> heaps[MAX_THREADS];
+    RunQueries(jobs, numQueries, results, [&](uint32_t query, std::vector<uint32_t>& ids, uint32_t thread)
+    {
+        // Walks outwards from the point's x, always to whichever side's next centre is nearer in x, keeping the k nearest
+        // in a max-heap. Once the x gap less the largest radius is beyond the kth nearest, nothing further out can be nearer
+        const PointQuery& q = queries[query];
+        std::vector<NearCircle>& heap = heaps[thread];
+        heap.clear();
+        uint32_t right = LowerBound(view, q.x);
+        uint32_t left = right;
+        while (k > 0 && (left > 0 || right < view.numStationary))
+        {
+            bool goRight = right < view.numStationary && (left == 0 || view.x[right] - q.x <= q.x - view.x[left - 1]);
+            uint32_t i = goRight ? right++ : --left;
+            float gap = goRight ? view.x[i] - q.x : q.x - view.x[i];
+            if (heap.size() == k && gap - view.maxRadius > heap.front().distance)
+            {
+                break;
+            }
+            if (!(view.y[i] == view.y[i]))
+            {
+                continue;
+            }
+
+            float dx = view.x[i] - q.x;
+            float dy = view.y[i] - q.y;
+            NearCircle circle = { std::sqrt((dx * dx) + (dy * dy)) - view.rad[i], i };
+            if (heap.size() < k)
+            {
+                heap.push_back(circle);
+                std::push_heap(heap.begin(), heap.end());
+            }
+            else if (circle < heap.front())
+            {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.back() = circle;
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+
+        std::sort_heap(heap.begin(), heap.end());
+        for (const NearCircle& circle : heap)
+        {
+            ids.push_back(view.ids[circle.index]);
+        }
+    });
+}
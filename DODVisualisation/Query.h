@@ -0,0 +1,78 @@
+// Query.h: Read-only batch queries over the stationary circles, which can run while the world steps
+#pragma once
+
+#include "Simulation.h"
+#include <cstdint>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Stationary Queries
+//---------------------------------------------------------------------------------------------------------------------
+
+// Batches of queries against the x-sorted stationary circles: the circles overlapping a circle, the circles overlapping a
+// box, and the k circles nearest a point. Queries only read the stationary SoA and ids, and only BeginStep writes those,
+// so a batch can run on another thread while AdvanceWorld moves the circles, with no lock. In a SimulationPipeline that
+// is any time between one LaunchStep and the next.
+// A batch is split into chunks of queries over a JobScheduler's threads. That can't be the scheduler stepping the world,
+// so to query alongside a pipelined step give queries a JobScheduler of their own.
+// Overlap results come in x-order and nearest results nearest first, with ties going to the circle first in x-order. A
+// query's result only depends on the stationary circles, so a batch gives the same results on any number of threads
+
+//Queries in each chunk of a batch, fewer than CHUNK_SIZE as one query walks many circles
+const uint32_t QUERY_CHUNK_SIZE = 16;
+
+// The stationary circles as of the last BeginStep. Take a new view after each one, as applying updates can reallocate
+// the arrays
+struct StationaryView
+{
+    uint32_t numStationary = 0; //Tombstones included, their y is NaN so no query finds them
+    const float* x = nullptr;
+    const float* y = nullptr;
+    const float* rad = nullptr;
+    const uint32_t* ids = nullptr;
+    float maxRadius = 0.0f;
+};
+
+struct CircleQuery
+{
+    float x;
+    float y;
+    float rad;
+};
+
+struct BoxQuery
+{
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+};
+
+struct PointQuery
+{
+    float x;
+    float y;
+};
+
+// Stationary ids found by a batch, query i's are ids[start[i]] up to ids[start[i + 1]]. Each chunk of queries collects
+// its ids on its own, then they are copied out in query order
+struct QueryResults
+{
+    std::vector<uint32_t> start;
+    std::vector<uint32_t> ids;
+
+    //Each chunk's ids, kept between batches so a warmed up batch doesn't allocate
+    std::vector<std::vector<uint32_t>> chunkIds;
+};
+
+StationaryView ViewStationary(const World& world);
+
+//Stationary circles overlapping each circle
+void QueryCircles(JobScheduler& jobs, const StationaryView& view, const CircleQuery* queries, uint32_t numQueries, QueryResults& results);
+
+//Stationary circles overlapping each box
+void QueryBoxes(JobScheduler& jobs, const StationaryView& view, const BoxQuery* queries, uint32_t numQueries, QueryResults& results);
+
+//The k stationary circles whose edges are nearest each point, negative distances being inside a circle. Fewer if there
+//aren't k
+void QueryNearest(JobScheduler& jobs, const StationaryView& view, const PointQuery* queries, uint32_t numQueries, uint32_t k, QueryResults& results);
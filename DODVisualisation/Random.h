@@ -0,0 +1,73 @@
+// Random.h: Counter-based random numbers that are the same on every platform and thread count
+#pragma once
+
+#include <cstdint>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Philox
+//---------------------------------------------------------------------------------------------------------------------
+
+// Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3"). Each call turns a 128 bit counter and a
+// 64 bit key into 128 random bits with no state carried between calls, so any value can be made on any thread in any
+// order. The world generator keys it by seed and stream and counts by circle index and field
+
+struct RandomBits
+{
+    uint32_t values[4];
+};
+
+//Independent sequences drawn from the same seed
+enum RandomStream : uint32_t
+{
+    RANDOM_MOVING,
+    RANDOM_STATIONARY,
+    RANDOM_CHURN,
+    RANDOM_QUERY
+};
+
+//Which of a circle's values a block of random bits is for
+enum RandomField : uint32_t
+{
+    RANDOM_CIRCLE,   //rad, x, y
+    RANDOM_VELOCITY, //x, y
+    RANDOM_NAME,     //Letters 0-3, then 4-7 and 8-9 at the next two fields
+    RANDOM_COLOUR = RANDOM_NAME + 3, //r, g, b
+    RANDOM_CHOICE //Anything else picked at random along with the circle
+};
+
+inline void PhiloxRound(uint32_t (&counter)[4], uint32_t key0, uint32_t key1)
+{
+    uint64_t product0 = static_cast<uint64_t>(0xD2511F53u) * counter[0];
+    uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57u) * counter[2];
+    uint32_t c1 = counter[1];
+    uint32_t c3 = counter[3];
+    counter[0] = static_cast<uint32_t>(product1 >> 32) ^ c1 ^ key0;
+    counter[1] = static_cast<uint32_t>(product1);
+    counter[2] = static_cast<uint32_t>(product0 >> 32) ^ c3 ^ key1;
+    counter[3] = static_cast<uint32_t>(product0);
+}
+
+//128 random bits for one field of one circle
+inline RandomBits Philox(uint32_t seed, RandomStream stream, uint32_t index, uint32_t field)
+{
+    uint32_t counter[4] = { index, field, 0, 0 };
+    uint32_t key0 = seed;
+    uint32_t key1 = stream;
+    for (int round = 0; round < 10; ++round)
+    {
+        PhiloxRound(counter, key0, key1);
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+    }
+    return { { counter[0], counter[1], counter[2], counter[3] } };
+}
+
+//Integer in [min, max] from 32 random bits. Multiply and shift rather than %, so no platform rand and a bias of at most
+//range / 2^32 between values, negligible for the ranges used here. Lemire's rejection step would remove it, but needs
+//more bits than the one block each field is drawn from. Worked in uint32_t so bounds up to 2^32 apart can't overflow
+inline int RandomRange(uint32_t bits, int min, int max)
+{
+    uint32_t range = static_cast<uint32_t>(max) - static_cast<uint32_t>(min) + 1;
+    uint32_t offset = range == 0 ? bits : static_cast<uint32_t>((static_cast<uint64_t>(bits) * range) >> 32); // 0 is all 2^32 values
+    return static_cast<int>(static_cast<uint32_t>(min) + offset);
+}
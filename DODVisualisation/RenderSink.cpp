@@ -0,0 +1,27 @@
+// RenderSink.cpp: Where each frame's moved circles are sent, in one call per frame
+
+#include "RenderSink.h"
+
+static void NullMoveCircles(void* context, uint32_t numMoving, const Circle* moving, const uint32_t* movingId, const uint64_t* changed)
+{
+}
+
+RenderSink NullRenderSink()
+{
+    return { "null", &NullMoveCircles, nullptr };
+}
+
+static void RecordMoveCircles(void* context, uint32_t numMoving, const Circle* moving, const uint32_t* movingId, const uint64_t* changed)
+{
+    RenderRecording& recording = *static_cast<RenderRecording*>(context);
+    ForEachChanged(numMoving, changed, [&](uint32_t i)
+    {
+        recording.moves.push_back({ recording.frames, movingId[i], moving[i].x, moving[i].y });
+    });
+    ++recording.frames;
+}
+
+RenderSink RecordingRenderSink(RenderRecording& recording)
+{
+    return { "recording", &RecordMoveCircles, &recording };
+}
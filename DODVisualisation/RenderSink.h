@@ -0,0 +1,71 @@
+// RenderSink.h: Where each frame's moved circles are sent, in one call per frame
+#pragma once
+
+#include "Pipeline.h"
+#include "Profile.h"
+#include <cstdint>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Render Sink
+//---------------------------------------------------------------------------------------------------------------------
+
+// A sink takes a whole frame's moving circles as contiguous arrays plus the frame's change mask, bit i of which is set when
+// circle i has moved more than MOVE_EPSILON since it was last sent. Circles whose bit is clear, and dead circles, which are
+// not in the arrays at all, cost nothing. The visualiser's sink moves TL-Engine models, the null and recording sinks are
+// for running and checking without a renderer
+
+typedef void (*MoveCirclesFn)(void* context, uint32_t numMoving, const Circle* moving, const uint32_t* movingId, const uint64_t* changed);
+
+struct RenderSink
+{
+    const char* name;
+    MoveCirclesFn moveCircles;
+    void* context;
+};
+
+//Sends the changed circles of frame to sink, every frame must be sent once and in order for the mask to hold
+inline void SubmitFrame(const RenderSink& sink, const FrameState& frame)
+{
+    PROFILE_SCOPE(PROFILE_MODEL_UPDATES);
+    sink.moveCircles(sink.context, frame.numMoving, frame.movingCircles.data(), frame.movingIds.data(), frame.changed.data());
+}
+
+//Calls fn(i) for every set bit i of a change mask, skipping 64 unchanged circles at a time
+template <typename Fn>
+void ForEachChanged(uint32_t numMoving, const uint64_t* changed, Fn&& fn)
+{
+    uint32_t numWords = (numMoving + 63) / 64;
+    for (uint32_t word = 0; word < numWords; ++word)
+    {
+        uint64_t bits = changed[word];
+        for (uint32_t i = word * 64; bits != 0; ++i, bits >>= 1)
+        {
+            if (bits & 1)
+            {
+                fn(i);
+            }
+        }
+    }
+}
+
+//Drops every frame, to time the simulation and the change masks without a renderer
+RenderSink NullRenderSink();
+
+//One circle sent to a recording sink
+struct RecordedMove
+{
+    uint32_t frame;
+    uint32_t id;
+    float x;
+    float y;
+};
+
+struct RenderRecording
+{
+    uint32_t frames = 0;
+    std::vector<RecordedMove> moves;
+};
+
+//Appends every changed circle of every frame to recording
+RenderSink RecordingRenderSink(RenderRecording& recording);
@@ -0,0 +1,1409 @@
+// Simulation.cpp: Circle simulation core shared by the visualiser and the headless runner
+
+#include "Simulation.h"
+#include "Profile.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Ties on x are broken on y then rad, so the sorted order is the same whatever sort makes it. Circles equal on all three
+// are identical
+bool CircleSorter(Circle const& lhs, Circle const& rhs)
+{
+    if (lhs.x != rhs.x)  return lhs.x < rhs.x;
+    if (lhs.y != rhs.y)  return lhs.y < rhs.y;
+    return lhs.rad < rhs.rad;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Continuous Collision
+//---------------------------------------------------------------------------------------------------------------------
+
+// A moving circle is tested over its whole move for the frame, not just where it ends up, so nothing is tunnelled
+// through. The broad phase uses the bounding circle of the move, every stationary touching that is a candidate, and the
+// earliest time of impact among them is solved in closed form. The circle is stopped at the point of contact and its
+// velocity reflected, so each contact costs the same whatever the speeds. Impacts at the same time go to the stationary
+// circle first in x-order, not the first one the broad phase found, so the result doesn't depend on where a search starts
+// or on which other circles are in the arrays. Only that first impact is a contact, the rest of the move is given up, so
+// the circle can hit whatever else is in its way next step
+
+const float NO_IMPACT = 2.0f; //Any time of impact above 1 is outside the move
+
+// Fraction of the move (dx, dy) from (x, y) at which the moving circle first touches a stationary circle at (sx, sy),
+// contact being the two radii added. Circles already overlapping give 0 if closing and NO_IMPACT if separating, so a
+// circle stopped just inside contact is not hit again as it leaves
+inline float TimeOfImpact(float x, float y, float dx, float dy, float sx, float sy, float contact)
+{
+    float relx = x - sx;
+    float rely = y - sy;
+    float b = (relx * dx) + (rely * dy);
+    if (!(b < 0.0f))
+    {
+        return NO_IMPACT;
+    }
+
+    float c = (relx * relx) + (rely * rely) - contact * contact;
+    if (c <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    // Smaller root of a t^2 + 2 b t + c = 0, written so nothing cancels when the move is short
+    float a = (dx * dx) + (dy * dy);
+    float disc = b * b - a * c;
+    if (disc < 0.0f)
+    {
+        return NO_IMPACT;
+    }
+    float t = c / (-b + sqrt(disc));
+    return t <= 1.0f ? t : NO_IMPACT;
+}
+
+// Puts the moving circle where it touches the stationary circle at (sx, sy) at time t of its move and reflects its
+// velocity off the contact normal
+inline void ResolveImpact(Circle* moving, CircleVelocity* movingVel, float x, float y, float dx, float dy, float t, float sx, float sy, float contact)
+{
+    float cx = x + dx * t;
+    float cy = y + dy * t;
+
+    float normx = sx - cx;
+    float normy = sy - cy;
+    float mag = sqrt((normx * normx) + (normy * normy));
+    if (mag > 0.0f)
+    {
+        normx /= mag;
+        normy /= mag;
+    }
+    else
+    {
+        normx = 1.0f;
+        normy = 0.0f;
+    }
+
+    // Overlapping from the start, so push out to touching
+    if (t == 0.0f)
+    {
+        cx = sx - normx * contact;
+        cy = sy - normy * contact;
+    }
+    moving->x = cx;
+    moving->y = cy;
+
+    //Refeclt velocity of the moving circle
+    float mvelx = movingVel->x;
+    float mvely = movingVel->y;
+    float dot = (mvelx * normx) + (mvely * normy);
+
+    movingVel->x = mvelx - normx * (dot * 2.0f);
+    movingVel->y = mvely - normy * (dot * 2.0f);
+}
+
+// The per-circle kernels are templates on the options so that each run uses a copy with the disabled features compiled
+// out. radius is the largest radius of any circle, and with RandRadius false the radius of every circle, so strip widths
+// and contact distances are constants.
+// Finding contacts and resolving them are separate passes. Detection only reads the circles and writes each chunk's
+// contacts to a buffer of its own, then the chunk resolves them against its own circles. A stationary circle can be hit
+// from any chunk, so its hp is taken after every chunk is done
+
+//Multithreaded method for finding the stationary circle each moving circle in [begin, end) hits first, if any. With Death,
+//circles whose hp ran out in an earlier fixed sub-step are still in the arrays until the next BeginStep, so they are skipped
+template <bool RandRadius, bool Death>
+static void FindStationaryContacts(float frametime, uint32_t begin, uint32_t end, const Circle* moving, const CircleVelocity* movingVel, uint32_t numStationary, Circle* stationary, const StationarySoA& stationarySoA, const int32_t* stationaryHp, std::vector<StationaryContact>& contacts, float radius)
+{
+    auto movingEnd = moving + end;
+    moving += begin;
+    movingVel += begin;
+    uint32_t index = begin;
+    contacts.clear();
+    auto stationaryEnd = stationary + numStationary;
+    const FindContactFn findFirst = RandRadius ? narrowPhase.findFirst : narrowPhase.findFirstUniform;
+    const FindContactFn findLast = RandRadius ? narrowPhase.findLast : narrowPhase.findLastUniform;
+    const float* sxs = stationarySoA.x.data();
+    const float* sys = stationarySoA.y.data();
+    const float* srads = stationarySoA.rad.data();
+    PROFILE_ONLY(uint32_t searchSteps = 0;)
+    PROFILE_ONLY(uint32_t narrowCalls = 0;)
+    PROFILE_ONLY(uint32_t candidates = 0;)
+    PROFILE_ONLY(uint32_t numContacts = 0;)
+
+    while (moving != movingEnd)
+    {
+        float x = moving->x;
+        float y = moving->y;
+        float dx = movingVel->x * frametime;
+        float dy = movingVel->y * frametime;
+
+        float mrad = RandRadius ? moving->rad : radius;
+
+        // Bounding circle of the whole move
+        float bx = x + dx * 0.5f;
+        float by = y + dy * 0.5f;
+        float brad = mrad + 0.5f * sqrt((dx * dx) + (dy * dy));
+
+        float bradx = bx - brad;
+        float bxrad = bx + brad;
+
+        //Binary search
+        auto s = stationary;
+        auto e = stationaryEnd;
+        Circle* mid;
+        bool found = false;
+        if (s != e) do // Every stationary circle may have been removed
+        {
+            mid = s + (e - s) / 2;
+            PROFILE_ONLY(++searchSteps;)
+
+            // Circles are sorted by centre, so only bounds using the largest radius rule out everything past mid
+            float midradx = mid->x - radius;
+            float midxrad = mid->x + radius;
+
+            if (bxrad <= midradx)
+            {
+                e = mid;
+            }
+            else if (bradx >= midxrad)
+            {
+                s = mid;
+            }
+            else found = true;
+        } while (!found && e - s > 1);
+
+        uint32_t hit = NO_CONTACT;
+        float hitTime = NO_IMPACT;
+
+        // If no overlapping x-range found then no collision
+        if (found)
+        {
+            // The strip is widened by the largest radius for the same reason. The uniform kernels take the contact distance
+            float findRad = RandRadius ? brad : brad + radius;
+            float stopRight = bxrad + radius;
+            float stopLeft = bradx - radius;
+
+            // Each direction makes one narrow phase call per candidate plus the one that finds no more
+            PROFILE_ONLY(narrowCalls += 2;)
+            auto candidate = [&](uint32_t i)
+            {
+                PROFILE_ONLY(++candidates;)
+                PROFILE_ONLY(++narrowCalls;)
+                if (Death && stationaryHp[i] <= 0)
+                {
+                    return;
+                }
+                float srad = RandRadius ? srads[i] : radius;
+                float t = TimeOfImpact(x, y, dx, dy, sxs[i], sys[i], mrad + srad);
+                if (t < hitTime || (t == hitTime && hit != NO_CONTACT && i < hit))
+                {
+                    hitTime = t;
+                    hit = i;
+                }
+            };
+
+            // Every stationary touching the bounding circle, in the strip rightwards from the one found then leftwards
+            uint32_t midIndex = static_cast<uint32_t>(mid - stationary);
+            for (uint32_t i = findFirst(sxs, sys, srads, midIndex, numStationary, bx, by, findRad, stopRight); i != NO_CONTACT; i = findFirst(sxs, sys, srads, i + 1, numStationary, bx, by, findRad, stopRight))
+            {
+                candidate(i);
+            }
+            for (uint32_t i = findLast(sxs, sys, srads, 0, midIndex, bx, by, findRad, stopLeft); i != NO_CONTACT; i = findLast(sxs, sys, srads, 0, i, bx, by, findRad, stopLeft))
+            {
+                candidate(i);
+            }
+        }
+
+        if (hit != NO_CONTACT)
+        {
+            PROFILE_ONLY(++numContacts;)
+            contacts.push_back({ index, hit, hitTime });
+        }
+        ++moving;
+        ++movingVel;
+        ++index;
+    }
+
+    PROFILE_COUNT(PROFILE_SEARCH_STEPS, searchSteps);
+    PROFILE_COUNT(PROFILE_NARROW_CALLS, narrowCalls);
+    PROFILE_COUNT(PROFILE_CANDIDATES, candidates);
+    PROFILE_COUNT(PROFILE_CONTACTS, numContacts);
+}
+
+//Cell column holding x, clamped to the grid in float so circles far outside it can't overflow the int conversion
+static int GridCellX(const StationaryGrid& grid, float x)
+{
+    float cell = (x - grid.minX) / grid.cellSize;
+    return static_cast<int>(std::min(std::max(cell, 0.0f), static_cast<float>(grid.width - 1)));
+}
+
+static int GridCellY(const StationaryGrid& grid, float y)
+{
+    float cell = (y - grid.minY) / grid.cellSize;
+    return static_cast<int>(std::min(std::max(cell, 0.0f), static_cast<float>(grid.height - 1)));
+}
+
+//Counting sort of the stationary circles into grid cells covering the generation bounds
+void BuildStationaryGrid(uint32_t numStationary, Circle* stationary, const SimulationOptions& options, StationaryGrid& grid)
+{
+    // Spans in double as the int bounds can be up to 2^32 apart
+    double spanX = static_cast<double>(options.maxX) - options.minX;
+    double spanY = static_cast<double>(options.maxY) - options.minY;
+    float cellSize = MaxRadius(options) * 2.0f;
+    auto cellsAcross = [&](double span) { return std::floor(span / cellSize) + 1.0; };
+    while (cellsAcross(spanX) * cellsAcross(spanY) > MAX_GRID_CELLS)
+    {
+        cellSize *= 2.0f;
+    }
+
+    grid.minX = static_cast<float>(options.minX);
+    grid.minY = static_cast<float>(options.minY);
+    grid.cellSize = cellSize;
+    grid.width = static_cast<int>(cellsAcross(spanX));
+    grid.height = static_cast<int>(cellsAcross(spanY));
+    uint32_t numCells = static_cast<uint32_t>(grid.width) * static_cast<uint32_t>(grid.height);
+
+    grid.cellStart.assign(numCells + 1, 0);
+    ParallelResize(grid.x, numStationary);
+    ParallelResize(grid.y, numStationary);
+    ParallelResize(grid.rad, numStationary);
+    ParallelResize(grid.index, numStationary);
+    ParallelResize(grid.slot, numStationary);
+
+    std::vector<uint32_t> cells(numStationary);
+    for (uint32_t i = 0; i < numStationary; ++i)
+    {
+        cells[i] = static_cast<uint32_t>(GridCellY(grid, stationary[i].y)) * grid.width + GridCellX(grid, stationary[i].x);
+        ++grid.cellStart[cells[i] + 1];
+    }
+
+    for (uint32_t c = 0; c < numCells; ++c)
+    {
+        grid.cellStart[c + 1] += grid.cellStart[c];
+    }
+
+    std::vector<uint32_t> next(grid.cellStart.begin(), grid.cellStart.end() - 1);
+    for (uint32_t i = 0; i < numStationary; ++i)
+    {
+        uint32_t slot = next[cells[i]]++;
+        grid.x[slot] = stationary[i].x;
+        grid.y[slot] = stationary[i].y;
+        grid.rad[slot] = stationary[i].rad;
+        grid.index[slot] = i;
+        grid.slot[i] = slot;
+    }
+}
+
+//FindStationaryContacts using the stationary grid
+template <bool RandRadius, bool Death>
+static void FindStationaryContactsGrid(float frametime, uint32_t begin, uint32_t end, const Circle* moving, const CircleVelocity* movingVel, const StationaryGrid& grid, const int32_t* stationaryHp, std::vector<StationaryContact>& contacts, float radius)
+{
+    auto movingEnd = moving + end;
+    moving += begin;
+    movingVel += begin;
+    uint32_t index = begin;
+    contacts.clear();
+    const FindContactFn findFirst = RandRadius ? narrowPhase.findFirst : narrowPhase.findFirstUniform;
+    const float* sxs = grid.x.data();
+    const float* sys = grid.y.data();
+    const float* srads = grid.rad.data();
+    const float noStop = std::numeric_limits<float>::infinity();
+    PROFILE_ONLY(uint32_t narrowCalls = 0;)
+    PROFILE_ONLY(uint32_t candidates = 0;)
+    PROFILE_ONLY(uint32_t numContacts = 0;)
+
+    while (moving != movingEnd)
+    {
+        float x = moving->x;
+        float y = moving->y;
+        float dx = movingVel->x * frametime;
+        float dy = movingVel->y * frametime;
+
+        float mrad = RandRadius ? moving->rad : radius;
+
+        // Bounding circle of the whole move
+        float bx = x + dx * 0.5f;
+        float by = y + dy * 0.5f;
+        float brad = mrad + 0.5f * sqrt((dx * dx) + (dy * dy));
+        float findRad = RandRadius ? brad : brad + radius;
+
+        // Cells holding any stationary centre that can touch the bounding circle. Clamped the same way the build clamps,
+        // as the edge cells also hold every stationary circle past them, so a move beyond the grid still searches them
+        float reach = brad + radius;
+        int cxStart = GridCellX(grid, bx - reach);
+        int cxEnd = GridCellX(grid, bx + reach);
+        int cyStart = GridCellY(grid, by - reach);
+        int cyEnd = GridCellY(grid, by + reach);
+
+        uint32_t hit = NO_CONTACT;
+        float hitTime = NO_IMPACT;
+        for (int cy = cyStart; cy <= cyEnd; ++cy)
+        {
+            // Cells in a row are adjacent so the cells of a row are one contiguous run
+            uint32_t rowStart = grid.cellStart[cy * grid.width + cxStart];
+            uint32_t rowEnd = grid.cellStart[cy * grid.width + cxEnd + 1];
+            PROFILE_ONLY(++narrowCalls;)
+            for (uint32_t i = findFirst(sxs, sys, srads, rowStart, rowEnd, bx, by, findRad, noStop); i != NO_CONTACT; i = findFirst(sxs, sys, srads, i + 1, rowEnd, bx, by, findRad, noStop))
+            {
+                PROFILE_ONLY(++candidates;)
+                PROFILE_ONLY(++narrowCalls;)
+                if (Death && stationaryHp[grid.index[i]] <= 0)
+                {
+                    continue;
+                }
+                float srad = RandRadius ? srads[i] : radius;
+                float t = TimeOfImpact(x, y, dx, dy, sxs[i], sys[i], mrad + srad);
+                if (t < hitTime || (t == hitTime && hit != NO_CONTACT && grid.index[i] < grid.index[hit]))
+                {
+                    hitTime = t;
+                    hit = i;
+                }
+            }
+        }
+
+        if (hit != NO_CONTACT)
+        {
+            PROFILE_ONLY(++numContacts;)
+            contacts.push_back({ index, grid.index[hit], hitTime });
+        }
+        ++moving;
+        ++movingVel;
+        ++index;
+    }
+
+    PROFILE_COUNT(PROFILE_NARROW_CALLS, narrowCalls);
+    PROFILE_COUNT(PROFILE_CANDIDATES, candidates);
+    PROFILE_COUNT(PROFILE_CONTACTS, numContacts);
+}
+
+// Moves each circle in [begin, end) to the end of its move, or to its contact and off the stationary circle it hit. The
+// contacts are the chunk's own, in moving order, so a chunk only writes its own circles. Other chunks can hit the same
+// stationary circle, so each hit only goes on the thread's hits, for ReduceStationaryHits
+template <bool RandRadius>
+static void ResolveStationaryContacts(float frametime, uint32_t begin, uint32_t end, Circle* moving, CircleVelocity* movingVel, int32_t* movingHp, const StationarySoA& stationarySoA, const std::vector<StationaryContact>& contacts, std::vector<uint32_t>& hits, float radius)
+{
+    auto contact = contacts.begin();
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        float x = moving[i].x;
+        float y = moving[i].y;
+        float dx = movingVel[i].x * frametime;
+        float dy = movingVel[i].y * frametime;
+
+        if (contact != contacts.end() && contact->moving == i)
+        {
+            uint32_t s = contact->stationary;
+            float mrad = RandRadius ? moving[i].rad : radius;
+            float srad = RandRadius ? stationarySoA.rad[s] : radius;
+            ResolveImpact(&moving[i], &movingVel[i], x, y, dx, dy, contact->time, stationarySoA.x[s], stationarySoA.y[s], mrad + srad);
+            movingHp[i] -= 20;
+            hits.push_back(s);
+            ++contact;
+        }
+        else
+        {
+            moving[i].x = x + dx;
+            moving[i].y = y + dy;
+        }
+    }
+}
+
+// The hp each stationary circle lost in a step is a sum over every thread's hits. Each thread sorts its own hits, then
+// each range of stationary circles takes its hits from every thread's, found by binary search, so no two threads write
+// the same hp. Integer sums don't depend on order, so the hp is the same for any thread count
+
+//Stationary circles a reduction chunk covers, many as most have no hits
+static const uint32_t HITS_CHUNK_SIZE = 16 * CHUNK_SIZE;
+
+//Takes the hp of every stationary circle in the threads' hits
+static void ReduceStationaryHits(StationaryHits* threadHits, uint32_t numThreads, uint32_t numStationary, int32_t* stationaryHp)
+{
+    uint32_t numHits = 0;
+    for (uint32_t thread = 0; thread < numThreads; ++thread)
+    {
+        numHits += static_cast<uint32_t>(threadHits[thread].indices.size());
+    }
+    if (numHits == 0)
+    {
+        return;
+    }
+
+    ParallelFor(0, numThreads, 1, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        for (uint32_t hitsThread = chunkBegin; hitsThread < chunkEnd; ++hitsThread)
+        {
+            std::sort(threadHits[hitsThread].indices.begin(), threadHits[hitsThread].indices.end());
+        }
+    });
+
+    ParallelFor(0, numStationary, HITS_CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        for (uint32_t hitsThread = 0; hitsThread < numThreads; ++hitsThread)
+        {
+            const std::vector<uint32_t>& hits = threadHits[hitsThread].indices;
+            for (auto hit = std::lower_bound(hits.begin(), hits.end(), chunkBegin); hit != hits.end() && *hit < chunkEnd; ++hit)
+            {
+                stationaryHp[*hit] -= 20;
+            }
+        }
+    });
+}
+
+//Takes the hp of every stationary circle hit this step one contact at a time, in chunk order, so each event carries the
+//hp after its own hit and the events come out the same on any number of threads
+static void ApplyStationaryContacts(const std::vector<StationaryContact>* chunkContacts, uint32_t numChunks, const int32_t* movingHp, const uint32_t* movingId, int32_t* stationaryHp, const uint32_t* stationaryId, CollisionEventRing& events)
+{
+    for (uint32_t chunk = 0; chunk < numChunks; ++chunk)
+    {
+        for (auto& contact : chunkContacts[chunk])
+        {
+            stationaryHp[contact.stationary] -= 20;
+            PushCollisionEvent(events, CollisionKind::Stationary, movingId[contact.moving], stationaryId[contact.stationary], movingHp[contact.moving], stationaryHp[contact.stationary]);
+        }
+    }
+}
+
+//Multithreaded method for checking if circles collide with walls
+template <bool RandRadius>
+static void CheckWallCollision(uint32_t numMoving, Circle* moving, CircleVelocity* movingVel, const WorldBounds& walls, float radius)
+{
+    const float wallMinX = walls.minX;
+    const float wallMaxX = walls.maxX;
+    const float wallMinY = walls.minY;
+    const float wallMaxY = walls.maxY;
+
+    auto movingEnd = moving + numMoving;
+
+    while (moving != movingEnd)
+    {
+        float mvelx = movingVel->x;
+        float mvely = movingVel->y;
+
+        float mx = moving->x;
+        float my = moving->y;
+
+        float mrad = RandRadius ? moving->rad : radius;
+
+        if (mx - mrad <= wallMinX)
+        {
+            //Move the circle so it is no longer colliding
+            moving->x = wallMinX + mrad + 1.0f;
+
+            //Refeclt velocity of the moving circle         
+            movingVel->x = mvelx - 1.0f * (mvelx * 2.0f);
+            movingVel->y = mvely - 0.0f * (mvelx * 2.0f);
+        }
+        else if (mx + mrad >= wallMaxX)
+        {
+            //Move the circle so it is no longer colliding
+            moving->x = wallMaxX - mrad - 1.0f;
+
+            //Refeclt velocity of the moving circle
+            movingVel->x = mvelx + 1 * (-mvelx * 2.0f);
+            movingVel->y = mvely - 0.0f * (-mvelx * 2.0f);
+        }
+        else if (my - mrad <= wallMinY)
+        {
+            //Move the circle so it is no longer colliding
+            moving->y = wallMinY + mrad + 1.0f;
+
+            //Refeclt velocity of the moving circle
+            movingVel->x = mvelx - 0.0f * (mvely * 2.0f);
+            movingVel->y = mvely - 1.0f * (mvely * 2.0f);
+        }
+        else if (my + mrad >= wallMaxY)
+        {
+            //Move the circle so it is no longer colliding
+            moving->y = wallMaxY - mrad - 1.0f;
+
+            //Refeclt velocity of the moving circle
+            movingVel->x = mvelx - 0.0f * (-mvely * 2.0f);
+            movingVel->y = mvely + 1.0f * (-mvely * 2.0f);
+        }
+        ++moving;
+        ++movingVel;
+    }
+}
+
+//Sorts the moving arrays on x at start-up, permuting every parallel array together
+void SortMovingByX(uint32_t numMoving, Circle* moving, CircleVelocity* movingVel, int32_t* movingHp, uint32_t* movingId, CircleColourData* movingColour)
+{
+    std::vector<uint32_t> order(numMoving);
+    for (uint32_t i = 0; i < numMoving; ++i)
+    {
+        order[i] = i;
+    }
+    // Ties on x keep the array order, so the order is the same whatever sort makes it
+    ParallelSort(order.data(), numMoving, [&](uint32_t lhs, uint32_t rhs) { return moving[lhs].x < moving[rhs].x || (moving[lhs].x == moving[rhs].x && lhs < rhs); });
+
+    std::vector<Circle> sortedCircles(numMoving);
+    std::vector<CircleVelocity> sortedVels(numMoving);
+    std::vector<int32_t> sortedHp(numMoving);
+    std::vector<uint32_t> sortedIds(numMoving);
+    std::vector<CircleColourData> sortedColours(numMoving);
+    for (uint32_t i = 0; i < numMoving; ++i)
+    {
+        sortedCircles[i] = moving[order[i]];
+        sortedVels[i] = movingVel[order[i]];
+        sortedHp[i] = movingHp[order[i]];
+        sortedIds[i] = movingId[order[i]];
+        sortedColours[i] = movingColour[order[i]];
+    }
+    std::copy(sortedCircles.begin(), sortedCircles.end(), moving);
+    std::copy(sortedVels.begin(), sortedVels.end(), movingVel);
+    std::copy(sortedHp.begin(), sortedHp.end(), movingHp);
+    std::copy(sortedIds.begin(), sortedIds.end(), movingId);
+    std::copy(sortedColours.begin(), sortedColours.end(), movingColour);
+}
+
+//Spreads the low 16 bits of v out to the even bits
+static uint32_t SpreadBits(uint32_t v)
+{
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+//Position on a Morton curve through a 65536 x 65536 grid over the walls, interleaving the cell's x and y bits. Circles
+//outside the walls, when they are off, go to the edge cells
+static uint32_t MortonKey(const Circle& circle, const WorldBounds& walls)
+{
+    float cellsX = 65535.0f / (walls.maxX - walls.minX);
+    float cellsY = 65535.0f / (walls.maxY - walls.minY);
+    uint32_t x = static_cast<uint32_t>(std::min(std::max((circle.x - walls.minX) * cellsX, 0.0f), 65535.0f));
+    uint32_t y = static_cast<uint32_t>(std::min(std::max((circle.y - walls.minY) * cellsY, 0.0f), 65535.0f));
+    return SpreadBits(x) | (SpreadBits(y) << 1);
+}
+
+//Replaces array with its elements in order, the index of each in the low 32 bits. Each chunk is gathered by one thread,
+//which also places the chunk's new pages
+template <typename T>
+static void GatherMoving(AlignedVector<T>& array, const AlignedVector<uint64_t>& order)
+{
+    uint32_t count = static_cast<uint32_t>(order.size());
+    AlignedVector<T> gathered(count);
+    ParallelFor(0, count, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        for (uint32_t i = chunkBegin; i < chunkEnd; ++i)
+        {
+            gathered[i] = array[static_cast<uint32_t>(order[i])];
+        }
+    });
+    array.swap(gathered);
+}
+
+void ReorderMovingByMorton(World& world)
+{
+    // The key above the index, so the keys are distinct and the order is the same whatever sort makes it
+    uint32_t numMoving = world.numMoving;
+    AlignedVector<uint64_t> order(numMoving);
+    ParallelFor(0, numMoving, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        for (uint32_t i = chunkBegin; i < chunkEnd; ++i)
+        {
+            order[i] = (static_cast<uint64_t>(MortonKey(world.movingCircles[i], world.walls)) << 32) | i;
+        }
+    });
+    ParallelSort(order.data(), numMoving, [](uint64_t lhs, uint64_t rhs) { return lhs < rhs; });
+
+    GatherMoving(world.movingCircles, order);
+    GatherMoving(world.movingVelocitys, order);
+    GatherMoving(world.movingHp, order);
+    GatherMoving(world.movingIds, order);
+    GatherMoving(world.movingColours, order);
+}
+
+//Restores the x-sort of the moving arrays each frame. Circles only move a little per frame so most of the order
+//survives and an insertion sort is close to O(n)
+void ResortMovingByX(uint32_t numMoving, Circle* moving, CircleVelocity* movingVel, int32_t* movingHp, uint32_t* movingId, CircleColourData* movingColour)
+{
+    for (uint32_t i = 1; i < numMoving; ++i)
+    {
+        if (!(moving[i].x < moving[i - 1].x))
+        {
+            continue;
+        }
+
+        Circle circle = moving[i];
+        CircleVelocity vel = movingVel[i];
+        int32_t hp = movingHp[i];
+        uint32_t id = movingId[i];
+        CircleColourData colour = movingColour[i];
+
+        uint32_t j = i;
+        do
+        {
+            moving[j] = moving[j - 1];
+            movingVel[j] = movingVel[j - 1];
+            movingHp[j] = movingHp[j - 1];
+            movingId[j] = movingId[j - 1];
+            movingColour[j] = movingColour[j - 1];
+            --j;
+        } while (j > 0 && circle.x < moving[j - 1].x);
+
+        moving[j] = circle;
+        movingVel[j] = vel;
+        movingHp[j] = hp;
+        movingId[j] = id;
+        movingColour[j] = colour;
+    }
+}
+
+//Multithreaded method for finding overlapping moving circles. Each circle in [begin, end) sweeps rightwards through the x-sorted
+//moving array, so every pair is found exactly once, by the thread that owns its left circle
+template <bool RandRadius>
+static void FindMovingPairs(uint32_t begin, uint32_t end, uint32_t numMoving, Circle* moving, std::vector<MovingPair>& pairs, float maxRadius)
+{
+    const float contact = (maxRadius + maxRadius) * (maxRadius + maxRadius);
+
+    pairs.clear();
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        float mx = moving[i].x;
+        float my = moving[i].y;
+        float mrad = RandRadius ? moving[i].rad : maxRadius;
+        float stripEnd = mx + mrad + maxRadius;
+
+        for (uint32_t j = i + 1; j < numMoving && moving[j].x < stripEnd; ++j)
+        {
+            float dx = moving[j].x - mx;
+            float dy = moving[j].y - my;
+
+            if (RandRadius ? CirclesOverlap(dx, dy, mrad + moving[j].rad) : UniformCirclesOverlap(dx, dy, contact))
+            {
+                pairs.push_back({ i, j });
+            }
+        }
+    }
+}
+
+//Separates and bounces each overlapping pair of moving circles, in order. Pairs found by different threads can share
+//circles, so only run pairs that share none in parallel, see ColourMovingPairs. events is null when no event output is wanted
+void ResolveMovingPairs(const MovingPair* pairs, uint32_t numPairs, Circle* moving, CircleVelocity* movingVel, int32_t* movingHp, const uint32_t* movingId, CollisionEventRing* events)
+{
+    auto pairsEnd = pairs + numPairs;
+    for (auto pair = pairs; pair != pairsEnd; ++pair)
+    {
+        auto& a = moving[pair->i];
+        auto& b = moving[pair->j];
+
+        float normx = b.x - a.x;
+        float normy = b.y - a.y;
+        float dist = sqrt((normx * normx) + (normy * normy));
+
+        // An earlier pair sharing a circle may have pushed this one apart already, and then it is no contact at all
+        if (dist >= a.rad + b.rad)
+        {
+            continue;
+        }
+        if (dist > 0.0f)
+        {
+            normx /= dist;
+            normy /= dist;
+        }
+        else
+        {
+            normx = 1.0f;
+            normy = 0.0f;
+        }
+
+        //Move both circles apart by half the overlap each
+        float halfOverlap = (a.rad + b.rad - dist) * 0.5f;
+        a.x -= normx * halfOverlap;
+        a.y -= normy * halfOverlap;
+        b.x += normx * halfOverlap;
+        b.y += normy * halfOverlap;
+
+        //Equal masses, so exchange the velocity components along the normal if the circles are approaching
+        auto& aVel = movingVel[pair->i];
+        auto& bVel = movingVel[pair->j];
+        float approach = ((bVel.x - aVel.x) * normx) + ((bVel.y - aVel.y) * normy);
+        if (approach < 0.0f)
+        {
+            aVel.x += normx * approach;
+            aVel.y += normy * approach;
+            bVel.x -= normx * approach;
+            bVel.y -= normy * approach;
+        }
+
+        movingHp[pair->i] -= 20;
+        movingHp[pair->j] -= 20;
+
+        if (events)
+        {
+            PushCollisionEvent(*events, CollisionKind::Moving, movingId[pair->i], movingId[pair->j], movingHp[pair->i], movingHp[pair->j]);
+        }
+    }
+}
+
+// Pairs sharing no circle can be resolved at the same time. Each pair takes the lowest colour above every earlier pair
+// sharing one of its circles, taking the pairs in chunk order, so resolving one colour after another meets each circle's
+// pairs in the same order as resolving them all on one thread, and gives bit-identical results
+
+//Fewer pairs than this are resolved on one thread, as a colour can't pay for a ParallelFor with less than a chunk of work
+static const uint32_t PARALLEL_PAIRS = 4 * CHUNK_SIZE;
+
+//Groups the pairs found in each chunk by colour into colours.pairs, with colour c from colours.start[c] to
+//colours.start[c + 1]. Returns the number of colours
+static uint32_t ColourMovingPairs(const std::vector<std::vector<MovingPair>>& chunkPairs, uint32_t numMoving, MovingPairColours& colours)
+{
+    // nextColour is one past the last colour each circle was given, it is zeroed again after use so only grows with the world
+    if (colours.nextColour.size() < numMoving)
+    {
+        colours.nextColour.resize(numMoving, 0);
+    }
+    uint32_t* nextColour = colours.nextColour.data();
+
+    // Counts go one place up, then a prefix sum turns them into starts. A colour is at most one past any so far
+    colours.colour.clear();
+    colours.start.assign(1, 0);
+    for (auto& pairs : chunkPairs)
+    {
+        for (auto& pair : pairs)
+        {
+            uint32_t colour = std::max(nextColour[pair.i], nextColour[pair.j]);
+            nextColour[pair.i] = colour + 1;
+            nextColour[pair.j] = colour + 1;
+            colours.colour.push_back(colour);
+            if (colour + 1 == colours.start.size())
+            {
+                colours.start.push_back(0);
+            }
+            ++colours.start[colour + 1];
+        }
+    }
+    uint32_t numColours = static_cast<uint32_t>(colours.start.size() - 1);
+    for (uint32_t c = 0; c < numColours; ++c)
+    {
+        colours.start[c + 1] += colours.start[c];
+    }
+
+    colours.pairs.resize(colours.colour.size());
+    colours.cursor.assign(colours.start.begin(), colours.start.end() - 1);
+    const uint32_t* colour = colours.colour.data();
+    for (auto& pairs : chunkPairs)
+    {
+        for (auto& pair : pairs)
+        {
+            colours.pairs[colours.cursor[*colour++]++] = pair;
+            nextColour[pair.i] = 0;
+            nextColour[pair.j] = 0;
+        }
+    }
+    return numColours;
+}
+
+//Multithreaded method for counting the circles that have run out of hp
+uint32_t DeathModel(uint32_t numMoving, const int32_t* movingHp)
+{
+    auto movingEnd = movingHp + numMoving;
+    uint32_t dead = 0;
+
+    while (movingHp != movingEnd)
+    {
+        if (*movingHp <= 0)
+        {
+            ++dead;
+        }
+        ++movingHp;
+    }
+    return dead;
+}
+
+//Removes the dead circles from every moving array. Live circles keep their order, so the x-sort survives without a resort.
+//The ids of the removed circles are appended to removed, and the live count is returned
+uint32_t RemoveDeadCircles(uint32_t numMoving, Circle* moving, CircleVelocity* movingVel, int32_t* movingHp, uint32_t* movingId, CircleColourData* movingColour, std::vector<uint32_t>& removed)
+{
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < numMoving; ++i)
+    {
+        if (movingHp[i] <= 0)
+        {
+            removed.push_back(movingId[i]);
+            continue;
+        }
+        if (live != i)
+        {
+            moving[live] = moving[i];
+            movingVel[live] = movingVel[i];
+            movingHp[live] = movingHp[i];
+            movingId[live] = movingId[i];
+            movingColour[live] = movingColour[i];
+        }
+        ++live;
+    }
+    return live;
+}
+
+Circle RandomCircle(const SimulationOptions& options, uint32_t seed, RandomStream stream, uint32_t index)
+{
+    RandomBits bits = Philox(seed, stream, index, RANDOM_CIRCLE);
+    Circle circle;
+    circle.rad = options.randRadius ? static_cast<float>(RandomRange(bits.values[0], options.minRadius, options.maxRadius)) : options.radius;
+    circle.x = static_cast<float>(RandomRange(bits.values[1], options.minX, options.maxX));
+    circle.y = static_cast<float>(RandomRange(bits.values[2], options.minY, options.maxY));
+    return circle;
+}
+
+CircleVelocity RandomVelocity(uint32_t seed, RandomStream stream, uint32_t index)
+{
+    RandomBits bits = Philox(seed, stream, index, RANDOM_VELOCITY);
+    CircleVelocity vel;
+    vel.x = static_cast<float>(RandomRange(bits.values[0], MINVEL_X, MAXVEL_X));
+    vel.y = static_cast<float>(RandomRange(bits.values[1], MINVEL_Y, MAXVEL_Y));
+    return vel;
+}
+
+CircleName RandomName(uint32_t seed, RandomStream stream, uint32_t index)
+{
+    // Four letters from each block of bits
+    CircleName name;
+    RandomBits bits;
+    for (uint32_t c = 0; c < NAME_LENGTH; ++c)
+    {
+        if (c % 4 == 0)
+        {
+            bits = Philox(seed, stream, index, RANDOM_NAME + c / 4);
+        }
+        name.text[c] = static_cast<char>('a' + RandomRange(bits.values[c % 4], 0, 25));
+    }
+    return name;
+}
+
+CircleColourData RandomColour(uint32_t seed, RandomStream stream, uint32_t index)
+{
+    RandomBits bits = Philox(seed, stream, index, RANDOM_COLOUR);
+    CircleColourData colour;
+    colour.r = RandomRange(bits.values[0], 0, 254) / 255.0f;
+    colour.g = RandomRange(bits.values[1], 0, 254) / 255.0f;
+    colour.b = RandomRange(bits.values[2], 0, 254) / 255.0f;
+    return colour;
+}
+
+WorldBounds WallBounds(const SimulationOptions& options)
+{
+    // Summed in double, as a tenth past bounds near the int limits doesn't fit in an int
+    WorldBounds walls;
+    walls.minX = static_cast<float>(static_cast<double>(options.minX) + options.minX / 10);
+    walls.maxX = static_cast<float>(static_cast<double>(options.maxX) + options.maxX / 10);
+    walls.minY = static_cast<float>(static_cast<double>(options.minY) + options.minY / 10);
+    walls.maxY = static_cast<float>(static_cast<double>(options.maxY) + options.maxY / 10);
+    return walls;
+}
+
+void GenerateWorld(World& world, const SimulationOptions& options, uint32_t seed)
+{
+    world.options = options;
+    world.walls = WallBounds(options);
+
+    world.numMoving = options.circles / 2;
+    world.numStationary = options.circles - world.numMoving;
+
+    // Resizing leaves the arrays unwritten, so the pages of each chunk are placed by the thread that fills it below
+    world.movingCircles.resize(world.numMoving);
+    world.movingVelocitys.resize(world.numMoving);
+    world.movingHp.resize(world.numMoving);
+    world.movingIds.resize(world.numMoving);
+    world.movingNames.resize(world.numMoving);
+    world.movingColours.resize(world.numMoving);
+
+    world.stationaryCircles.resize(world.numStationary);
+    world.stationaryHp.resize(world.numStationary);
+    world.stationaryIds.resize(world.numStationary);
+    world.stationaryNames.resize(world.numStationary);
+    world.stationaryColours.resize(world.numStationary);
+
+    // Every value is keyed by its circle's index, so the chunks can be filled by any thread in any order
+    ParallelFor(0, world.numMoving, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        for (uint32_t i = chunkBegin; i < chunkEnd; ++i)
+        {
+            world.movingCircles[i] = RandomCircle(options, seed, RANDOM_MOVING, i);
+            world.movingVelocitys[i] = RandomVelocity(seed, RANDOM_MOVING, i);
+            world.movingHp[i] = 100;
+            world.movingIds[i] = i;
+            world.movingNames[i] = RandomName(seed, RANDOM_MOVING, i);
+            world.movingColours[i] = RandomColour(seed, RANDOM_MOVING, i);
+        }
+    });
+
+    ParallelFor(0, world.numStationary, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        for (uint32_t i = chunkBegin; i < chunkEnd; ++i)
+        {
+            world.stationaryCircles[i] = RandomCircle(options, seed, RANDOM_STATIONARY, i);
+            world.stationaryHp[i] = 100;
+            world.stationaryIds[i] = i;
+            world.stationaryNames[i] = RandomName(seed, RANDOM_STATIONARY, i);
+            world.stationaryColours[i] = RandomColour(seed, RANDOM_STATIONARY, i);
+        }
+    });
+}
+
+//StepSimulation for one combination of options, every option test below is resolved at compile time
+template <BroadPhase Broad, bool RandRadius, bool Walls, bool MovingCollisions, bool Death, bool Events>
+static void StepWorld(World& world, float frameTime)
+{
+    // Before the array pointers are taken, as the reorder replaces the arrays
+    if (!MovingCollisions && world.options.reorderInterval > 0 && ++world.stepsSinceReorder >= world.options.reorderInterval)
+    {
+        PROFILE_SCOPE(PROFILE_REORDER);
+        ReorderMovingByMorton(world);
+        world.stepsSinceReorder = 0;
+    }
+
+    Circle* movingCircles = world.movingCircles.data();
+    CircleVelocity* movingVelocitys = world.movingVelocitys.data();
+    int32_t* movingHp = world.movingHp.data();
+    uint32_t* movingIds = world.movingIds.data();
+    CircleColourData* movingColours = world.movingColours.data();
+    Circle* stationaryCircles = world.stationaryCircles.data();
+    int32_t* stationaryHp = world.stationaryHp.data();
+    const uint32_t* stationaryIds = world.stationaryIds.data();
+    uint32_t numMoving = world.numMoving;
+    uint32_t numStationary = world.numStationary;
+    float radius = MaxRadius(world.options);
+
+    // Grown here rather than with the moving arrays, as a domain takes in migrants between steps
+    uint32_t numChunks = (numMoving + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    if (world.stationaryContacts.size() < numChunks)
+    {
+        world.stationaryContacts.resize(numChunks);
+    }
+
+    uint32_t numThreads = NumSchedulerThreads();
+    for (uint32_t thread = 0; thread < numThreads; ++thread)
+    {
+        world.stationaryHits[thread].indices.clear();
+    }
+
+    ParallelFor(0, numMoving, CHUNK_SIZE, world.collidePartition, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        uint32_t num = chunkEnd - chunkBegin;
+        std::vector<StationaryContact>& contacts = world.stationaryContacts[chunkBegin / CHUNK_SIZE];
+        {
+            PROFILE_SCOPE(PROFILE_COLLIDE);
+            if (Broad == BroadPhase::Grid)
+            {
+                FindStationaryContactsGrid<RandRadius, Death>(frameTime, chunkBegin, chunkEnd, movingCircles, movingVelocitys, world.stationaryGrid, stationaryHp, contacts, radius);
+            }
+            else
+            {
+                FindStationaryContacts<RandRadius, Death>(frameTime, chunkBegin, chunkEnd, movingCircles, movingVelocitys, numStationary, stationaryCircles, world.stationarySoA, stationaryHp, contacts, radius);
+            }
+        }
+        {
+            PROFILE_SCOPE(PROFILE_RESOLVE_CONTACTS);
+            ResolveStationaryContacts<RandRadius>(frameTime, chunkBegin, chunkEnd, movingCircles, movingVelocitys, movingHp, world.stationarySoA, contacts, world.stationaryHits[thread].indices, radius);
+        }
+        if (Walls)
+        {
+            PROFILE_SCOPE(PROFILE_WALLS);
+            CheckWallCollision<RandRadius>(num, movingCircles + chunkBegin, movingVelocitys + chunkBegin, world.walls, radius);
+        }
+    });
+
+    // Before the resort, as the contacts hold moving indices
+    {
+        PROFILE_SCOPE(PROFILE_STATIONARY_HITS);
+        if (Events)
+        {
+            ApplyStationaryContacts(world.stationaryContacts.data(), numChunks, movingHp, movingIds, stationaryHp, stationaryIds, collisionLog.rings[0]);
+        }
+        else
+        {
+            ReduceStationaryHits(world.stationaryHits, numThreads, numStationary, stationaryHp);
+        }
+    }
+
+    if (MovingCollisions)
+    {
+        // Restore the x-sort then sweep for pairs across the threads
+        {
+            PROFILE_SCOPE(PROFILE_RESORT);
+            ResortMovingByX(numMoving, movingCircles, movingVelocitys, movingHp, movingIds, movingColours);
+        }
+
+        ParallelFor(0, numMoving, CHUNK_SIZE, world.pairsPartition, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+        {
+            PROFILE_SCOPE(PROFILE_MOVING_PAIRS);
+            std::vector<MovingPair>& pairs = world.movingPairs[chunkBegin / CHUNK_SIZE];
+            FindMovingPairs<RandRadius>(chunkBegin, chunkEnd, numMoving, movingCircles, pairs, radius);
+            PROFILE_COUNT(PROFILE_MOVING_PAIRS_FOUND, static_cast<uint32_t>(pairs.size()));
+        });
+
+        // Resolve in chunk order, or colour by colour to the same effect, so the result does not depend on timing
+        PROFILE_SCOPE(PROFILE_RESOLVE_PAIRS);
+        uint32_t numPairs = 0;
+        for (auto& pairs : world.movingPairs)
+        {
+            numPairs += static_cast<uint32_t>(pairs.size());
+        }
+        PROFILE_COUNT(PROFILE_CONTACTS, numPairs);
+
+        if (numPairs < PARALLEL_PAIRS || NumSchedulerThreads() == 1)
+        {
+            for (auto& pairs : world.movingPairs)
+            {
+                ResolveMovingPairs(pairs.data(), static_cast<uint32_t>(pairs.size()), movingCircles, movingVelocitys, movingHp, movingIds, Events ? &collisionLog.rings[0] : nullptr);
+            }
+        }
+        else
+        {
+            MovingPairColours& colours = world.pairColours;
+            uint32_t numColours = ColourMovingPairs(world.movingPairs, numMoving, colours);
+            for (uint32_t c = 0; c < numColours; ++c)
+            {
+                const MovingPair* pairs = colours.pairs.data() + colours.start[c];
+                uint32_t num = colours.start[c + 1] - colours.start[c];
+                if (num < 2 * CHUNK_SIZE)
+                {
+                    ResolveMovingPairs(pairs, num, movingCircles, movingVelocitys, movingHp, movingIds, Events ? &collisionLog.rings[0] : nullptr);
+                    continue;
+                }
+                ParallelFor(0, num, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+                {
+                    ResolveMovingPairs(pairs + chunkBegin, chunkEnd - chunkBegin, movingCircles, movingVelocitys, movingHp, movingIds, Events ? &collisionLog.rings[thread] : nullptr);
+                });
+            }
+        }
+    }
+
+    if (Death)
+    {
+        PROFILE_SCOPE(PROFILE_DEATH);
+
+        // Only compact when something died, most frames nothing does
+        uint32_t dead[MAX_THREADS] = {};
+        ParallelFor(0, numMoving, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+        {
+            dead[thread] += DeathModel(chunkEnd - chunkBegin, movingHp + chunkBegin);
+        });
+
+        uint32_t totalDead = 0;
+        for (uint32_t thread = 0; thread < NumSchedulerThreads(); ++thread)
+        {
+            totalDead += dead[thread];
+        }
+        if (totalDead > 0)
+        {
+            world.numMoving = RemoveDeadCircles(numMoving, movingCircles, movingVelocitys, movingHp, movingIds, movingColours, world.removedMoving);
+            world.movingCircles.resize(world.numMoving);
+            world.movingVelocitys.resize(world.numMoving);
+            world.movingHp.resize(world.numMoving);
+            world.movingIds.resize(world.numMoving);
+            world.movingColours.resize(world.numMoving);
+            if (MovingCollisions)
+            {
+                world.movingPairs.resize((world.numMoving + CHUNK_SIZE - 1) / CHUNK_SIZE);
+            }
+        }
+
+        // Removing a stationary circle here would break the x-sort mid frame, so they leave through the update queue. Until
+        // then the contact pass skips them, so a later fixed sub-step can't hit them
+        for (uint32_t i = 0; i < world.numStationary; ++i)
+        {
+            if (stationaryHp[i] <= 0 && world.stationaryIndex[stationaryIds[i]] == i)
+            {
+                QueueStationaryRemove(world, stationaryIds[i]);
+            }
+        }
+    }
+}
+
+// Turns the runtime options into template arguments one at a time, ending with the StepWorld for all of them
+template <BroadPhase Broad, bool RandRadius, bool Walls, bool MovingCollisions, bool Death>
+static StepFn SelectStep(bool events)
+{
+    return events ? &StepWorld<Broad, RandRadius, Walls, MovingCollisions, Death, true> : &StepWorld<Broad, RandRadius, Walls, MovingCollisions, Death, false>;
+}
+
+template <BroadPhase Broad, bool RandRadius, bool Walls, bool MovingCollisions>
+static StepFn SelectStep(const SimulationOptions& options, bool events)
+{
+    return options.death ? SelectStep<Broad, RandRadius, Walls, MovingCollisions, true>(events) : SelectStep<Broad, RandRadius, Walls, MovingCollisions, false>(events);
+}
+
+template <BroadPhase Broad, bool RandRadius, bool Walls>
+static StepFn SelectStep(const SimulationOptions& options, bool events)
+{
+    return options.movingCollisions ? SelectStep<Broad, RandRadius, Walls, true>(options, events) : SelectStep<Broad, RandRadius, Walls, false>(options, events);
+}
+
+template <BroadPhase Broad, bool RandRadius>
+static StepFn SelectStep(const SimulationOptions& options, bool events)
+{
+    return options.walls ? SelectStep<Broad, RandRadius, true>(options, events) : SelectStep<Broad, RandRadius, false>(options, events);
+}
+
+template <BroadPhase Broad>
+static StepFn SelectStep(const SimulationOptions& options, bool events)
+{
+    return options.randRadius ? SelectStep<Broad, true>(options, events) : SelectStep<Broad, false>(options, events);
+}
+
+static StepFn SelectStep(const SimulationOptions& options, bool events)
+{
+    return options.broadPhase == BroadPhase::Grid ? SelectStep<BroadPhase::Grid>(options, events) : SelectStep<BroadPhase::Sweep>(options, events);
+}
+
+//Copies the x-sorted stationary circles into the narrow phase SoA
+static void BuildStationarySoA(World& world)
+{
+    auto& soa = world.stationarySoA;
+    soa.x.resize(world.numStationary);
+    soa.y.resize(world.numStationary);
+    soa.rad.resize(world.numStationary);
+    ParallelFor(0, world.numStationary, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        for (uint32_t i = chunkBegin; i < chunkEnd; ++i)
+        {
+            soa.x[i] = world.stationaryCircles[i].x;
+            soa.y[i] = world.stationaryCircles[i].y;
+            soa.rad[i] = world.stationaryCircles[i].rad;
+        }
+    });
+}
+
+//Points each stationary id at its index, for arrays with no tombstones
+static void IndexStationary(World& world)
+{
+    for (uint32_t i = 0; i < world.numStationary; ++i)
+    {
+        world.stationaryIndex[world.stationaryIds[i]] = i;
+    }
+}
+
+void PrepareWorld(World& world)
+{
+    ParallelSort(world.stationaryCircles.data(), world.numStationary, &CircleSorter);
+
+    world.stationaryIndex.assign(world.numStationary, NO_STATIONARY);
+    world.numTombstones = 0;
+    IndexStationary(world);
+
+    if (world.options.movingCollisions)
+    {
+        SortMovingByX(world.numMoving, world.movingCircles.data(), world.movingVelocitys.data(), world.movingHp.data(), world.movingIds.data(), world.movingColours.data());
+    }
+    else if (world.options.reorderInterval > 0)
+    {
+        ReorderMovingByMorton(world);
+    }
+
+    RestoreWorld(world);
+}
+
+//The grid is only built and kept up to date for the grid broad phase, the sweep never reads it
+static bool UsesGrid(const World& world)
+{
+    return world.options.broadPhase == BroadPhase::Grid;
+}
+
+void RestoreWorld(World& world)
+{
+    if (UsesGrid(world))
+    {
+        BuildStationaryGrid(world.numStationary, world.stationaryCircles.data(), world.options, world.stationaryGrid);
+    }
+    BuildStationarySoA(world);
+
+    // A circle whose id no longer points at it is a tombstone
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (uint32_t i = 0; i < world.numStationary; ++i)
+    {
+        if (world.stationaryIndex[world.stationaryIds[i]] != i)
+        {
+            world.stationarySoA.y[i] = nan;
+            if (UsesGrid(world))
+            {
+                world.stationaryGrid.y[world.stationaryGrid.slot[i]] = nan;
+            }
+        }
+    }
+
+    if (world.options.movingCollisions)
+    {
+        world.movingPairs.resize((world.numMoving + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    }
+
+    world.step = SelectStep(world.options, false);
+    world.stepWithEvents = SelectStep(world.options, true);
+}
+
+uint32_t QueueStationaryInsert(World& world, const Circle& circle, const CircleName& name, const CircleColourData& colour)
+{
+    // The id is handed out now but only gets an index once the insert is applied
+    uint32_t id = static_cast<uint32_t>(world.stationaryIndex.size());
+    world.stationaryIndex.push_back(NO_STATIONARY);
+    world.stationaryNames.push_back(name);
+
+    StationaryInsert insert;
+    insert.circle = circle;
+    insert.id = id;
+    insert.colour = colour;
+    world.stationaryInserts.push_back(insert);
+    return id;
+}
+
+void QueueStationaryRemove(World& world, uint32_t id)
+{
+    world.stationaryRemoves.push_back(id);
+}
+
+//Merges the queued inserts into the x-sorted stationary arrays and drops the tombstones, in place and in linear time
+static void MergeStationary(World& world)
+{
+    auto& inserts = world.stationaryInserts;
+    std::sort(inserts.begin(), inserts.end(), [](const StationaryInsert& lhs, const StationaryInsert& rhs)
+    {
+        return CircleSorter(lhs.circle, rhs.circle) || (!CircleSorter(rhs.circle, lhs.circle) && lhs.id < rhs.id);
+    });
+
+    Circle* circles = world.stationaryCircles.data();
+    int32_t* hp = world.stationaryHp.data();
+    uint32_t* ids = world.stationaryIds.data();
+    CircleColourData* colours = world.stationaryColours.data();
+
+    // Close up the tombstones, keeping the order
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < world.numStationary; ++i)
+    {
+        if (world.stationaryIndex[ids[i]] == NO_STATIONARY)
+        {
+            continue;
+        }
+        if (live != i)
+        {
+            circles[live] = circles[i];
+            hp[live] = hp[i];
+            ids[live] = ids[i];
+            colours[live] = colours[i];
+        }
+        ++live;
+    }
+
+    // Then merge from the back into the space at the end, so nothing is moved twice. Existing circles stay first on
+    // equal x, so the merge is stable
+    uint32_t numInserts = static_cast<uint32_t>(inserts.size());
+    uint32_t total = live + numInserts;
+    ParallelResize(world.stationaryCircles, total);
+    ParallelResize(world.stationaryHp, total);
+    ParallelResize(world.stationaryIds, total);
+    ParallelResize(world.stationaryColours, total);
+    circles = world.stationaryCircles.data();
+    hp = world.stationaryHp.data();
+    ids = world.stationaryIds.data();
+    colours = world.stationaryColours.data();
+
+    uint32_t i = live;
+    uint32_t j = numInserts;
+    for (uint32_t dst = total; j > 0; --dst)
+    {
+        if (i > 0 && inserts[j - 1].circle.x < circles[i - 1].x)
+        {
+            --i;
+            circles[dst - 1] = circles[i];
+            hp[dst - 1] = hp[i];
+            ids[dst - 1] = ids[i];
+            colours[dst - 1] = colours[i];
+        }
+        else
+        {
+            --j;
+            world.insertedStationary.push_back(inserts[j].id);
+            AddCollisionLogStationaryName(inserts[j].id, world.stationaryNames[inserts[j].id]);
+
+            circles[dst - 1] = inserts[j].circle;
+            hp[dst - 1] = 100;
+            ids[dst - 1] = inserts[j].id;
+            colours[dst - 1] = inserts[j].colour;
+        }
+    }
+    inserts.clear();
+
+    world.numStationary = total;
+    world.numTombstones = 0;
+
+    if (UsesGrid(world))
+    {
+        BuildStationaryGrid(world.numStationary, world.stationaryCircles.data(), world.options, world.stationaryGrid);
+    }
+    BuildStationarySoA(world);
+    IndexStationary(world);
+}
+
+void ApplyStationaryUpdates(World& world)
+{
+    PROFILE_SCOPE(PROFILE_STATIONARY_UPDATES);
+
+    // Removals only touch the removed circles
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (uint32_t id : world.stationaryRemoves)
+    {
+        if (id >= world.stationaryIndex.size() || world.stationaryIndex[id] == NO_STATIONARY)
+        {
+            continue;
+        }
+        uint32_t index = world.stationaryIndex[id];
+        world.stationarySoA.y[index] = nan;
+        if (UsesGrid(world))
+        {
+            world.stationaryGrid.y[world.stationaryGrid.slot[index]] = nan;
+        }
+        world.stationaryIndex[id] = NO_STATIONARY;
+        world.removedStationary.push_back(id);
+        ++world.numTombstones;
+    }
+    world.stationaryRemoves.clear();
+
+    if (!world.stationaryInserts.empty() || world.numTombstones * TOMBSTONE_MERGE_DIVISOR > world.numStationary)
+    {
+        MergeStationary(world);
+    }
+}
+
+void BeginStep(World& world)
+{
+    PROFILE_ONLY(ProfileFrame();)
+
+    world.removedMoving.clear();
+    world.removedStationary.clear();
+    world.insertedStationary.clear();
+    if (!world.stationaryInserts.empty() || !world.stationaryRemoves.empty())
+    {
+        ApplyStationaryUpdates(world);
+    }
+}
+
+void StepSimulation(World& world, float frameTime)
+{
+    BeginStep(world);
+    AdvanceWorld(world, frameTime);
+}
+
+void AdvanceWorld(World& world, float frameTime)
+{
+    PROFILE_SCOPE(PROFILE_STEP);
+
+    StepFn step = collisionLog.enabled ? world.stepWithEvents : world.step;
+    float fixedTimestep = world.options.fixedTimestep;
+    if (fixedTimestep > 0.0f)
+    {
+        world.unsimulatedTime += frameTime;
+        uint32_t steps = 0;
+        while (world.unsimulatedTime >= fixedTimestep && steps < MAX_FIXED_STEPS)
+        {
+            step(world, fixedTimestep);
+            world.unsimulatedTime -= fixedTimestep;
+            ++steps;
+        }
+        if (steps == MAX_FIXED_STEPS)
+        {
+            world.unsimulatedTime = 0.0f;
+        }
+    }
+    else
+    {
+        step(world, frameTime);
+    }
+}
@@ -0,0 +1,283 @@
+// Simulation.h: Circle simulation core shared by the visualiser and the headless runner
+#pragma once
+
+#include "Memory.h"
+#include "Options.h"
+#include "NarrowPhase.h"
+#include "CollisionLog.h"
+#include "JobScheduler.h"
+#include "Random.h"
+#include <cstdint>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Circle Data
+//---------------------------------------------------------------------------------------------------------------------
+
+// Circle data is plain, GenerateWorld fills it in from Philox keyed by circle index. Each circle also has an hp, which collisions write, and
+// an id, the index it was generated at. Ids are stable while the arrays get re-sorted and index the models and names.
+// Names (CircleName in CollisionLog.h) are cold, only the collision log formatter reads them, so they are kept apart in a
+// pool by id rather than next to the hp
+
+struct Circle
+{
+    float rad;
+    float x;
+    float y;
+};
+
+struct CircleVelocity
+{
+    float x;
+    float y;
+};
+
+struct CircleColourData
+{
+    float r;
+    float g;
+    float b;
+};
+
+bool CircleSorter(Circle const& lhs, Circle const& rhs);
+
+//A pair of overlapping moving circles, i < j are indices into the x-sorted moving arrays
+struct MovingPair
+{
+    uint32_t i;
+    uint32_t j;
+};
+
+//A moving circle's first impact with a stationary circle in a step, at time of the move, both indices into the arrays
+struct StationaryContact
+{
+    uint32_t moving;
+    uint32_t stationary;
+    float time;
+};
+
+// A step's moving pairs grouped by colour, no two pairs of a colour sharing a circle, so each colour can be resolved in
+// parallel. Kept between steps so the buffers are only allocated once
+struct MovingPairColours
+{
+    std::vector<MovingPair> pairs;
+    std::vector<uint32_t> start;  //Colour c is pairs[start[c]] up to pairs[start[c + 1]]
+    std::vector<uint32_t> colour; //Each found pair's colour, in chunk order
+    std::vector<uint32_t> cursor;
+    AlignedVector<uint32_t> nextColour; //By moving index, zero between steps
+};
+
+//Stationary indices one thread hit in a step, an entry per hit. On a cache line of its own so growing one thread's
+//doesn't disturb the others
+struct alignas(CACHE_LINE_SIZE) StationaryHits
+{
+    std::vector<uint32_t> indices;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Stationary Grid
+//---------------------------------------------------------------------------------------------------------------------
+
+// Any two touching circles have centres less than twice the largest radius apart, so with cells that size a circle only
+// needs the 3x3 block of cells around its centre, plus however far the bounding circle of its move reaches. Cells are
+// doubled in size until there are at most MAX_GRID_CELLS, as tiny radii or huge bounds would otherwise overflow the cell
+// indices. Bigger cells only mean more candidates per cell.
+// The circles are copied in cell order as SoA so a cell is a contiguous run, cellStart[c] to cellStart[c + 1]. index maps
+// back to the stationary arrays and slot maps the other way
+//Most cells a stationary grid has
+const uint32_t MAX_GRID_CELLS = 1 << 22;
+
+struct StationaryGrid
+{
+    float minX = 0.0f;
+    float minY = 0.0f;
+    float cellSize = 1.0f;
+    int width = 0;
+    int height = 0;
+
+    AlignedVector<uint32_t> cellStart;
+    AlignedVector<float> x;
+    AlignedVector<float> y;
+    AlignedVector<float> rad;
+    AlignedVector<uint32_t> index;
+    AlignedVector<uint32_t> slot; //Inverse of index
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Stationary SoA
+//---------------------------------------------------------------------------------------------------------------------
+
+// SoA copy of the x-sorted stationary circles for the narrow phase kernels, same order as stationaryCircles
+struct StationarySoA
+{
+    AlignedVector<float> x;
+    AlignedVector<float> y;
+    AlignedVector<float> rad;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Stationary Updates
+//---------------------------------------------------------------------------------------------------------------------
+
+// Stationary circles can be added and removed at runtime while the stationary arrays stay x-sorted. A removal leaves a
+// tombstone: the circle's y becomes NaN in the narrow phase copies so no overlap test can pass, and x is left alone so the
+// sort still holds. Inserts are sorted among themselves then merged in with one linear pass, which also drops the
+// tombstones. Updates are queued and applied together at the start of a StepSimulation, so a frame sees all of a batch
+// or none of it
+
+//stationaryIndex value of a removed stationary circle
+const uint32_t NO_STATIONARY = 0xFFFFFFFF;
+
+//Tombstones are merged away once they are more than 1 / TOMBSTONE_MERGE_DIVISOR of the stationary arrays
+const uint32_t TOMBSTONE_MERGE_DIVISOR = 8;
+
+struct StationaryInsert
+{
+    Circle circle;
+    uint32_t id;
+    CircleColourData colour;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// World
+//---------------------------------------------------------------------------------------------------------------------
+
+//Walls the moving circles bounce off
+struct WorldBounds
+{
+    float minX;
+    float maxX;
+    float minY;
+    float maxY;
+};
+
+struct World;
+
+//A specialisation of StepSimulation for one set of options
+typedef void (*StepFn)(World& world, float frameTime);
+
+// Everything being simulated. The moving and stationary data are parallel arrays, element i of each describes the same circle.
+// With death on, dead moving circles are removed from the arrays and numMoving is the live count. numStationary counts
+// tombstones too, until they are merged away
+struct World
+{
+    SimulationOptions options;
+    WorldBounds walls;
+
+    uint32_t numMoving = 0;
+    uint32_t numStationary = 0;
+
+    AlignedVector<Circle> movingCircles;
+    AlignedVector<CircleVelocity> movingVelocitys;
+    AlignedVector<int32_t> movingHp;
+    AlignedVector<uint32_t> movingIds;
+    AlignedVector<CircleColourData> movingColours;
+
+    AlignedVector<Circle> stationaryCircles;
+    AlignedVector<int32_t> stationaryHp;
+    AlignedVector<uint32_t> stationaryIds;
+    AlignedVector<CircleColourData> stationaryColours;
+
+    //Name pools indexed by id, not by array index, so they are never moved by a sort
+    AlignedVector<CircleName> movingNames;
+    AlignedVector<CircleName> stationaryNames;
+
+    StationaryGrid stationaryGrid; //Only built with the grid broad phase
+    StationarySoA stationarySoA;
+
+    //Stationary id to index in the stationary arrays, NO_STATIONARY once removed. Ids are never reused
+    AlignedVector<uint32_t> stationaryIndex;
+    uint32_t numTombstones = 0;
+
+    //Queued for the next StepSimulation
+    std::vector<StationaryInsert> stationaryInserts;
+    std::vector<uint32_t> stationaryRemoves;
+
+    //Stationary contacts found in each chunk, in moving order, and the stationary circles each thread's chunks hit
+    std::vector<std::vector<StationaryContact>> stationaryContacts;
+    StationaryHits stationaryHits[MAX_THREADS];
+
+    //Moving-moving pairs found in each chunk, resolved in chunk order so the result does not depend on which thread ran a chunk
+    std::vector<std::vector<MovingPair>> movingPairs;
+    MovingPairColours pairColours;
+
+    //Chunk costs of the collision loops, dealing each thread its share of the next step's work. The moving circles keep
+    //their x-sort, or barely move between steps, so a chunk costs about the same from one step to the next
+    ChunkPartition collidePartition;
+    ChunkPartition pairsPartition;
+
+    //Ids of the circles removed and added during the last StepSimulation
+    std::vector<uint32_t> removedMoving;
+    std::vector<uint32_t> removedStationary;
+    std::vector<uint32_t> insertedStationary;
+
+    //Frame time not yet simulated in fixed timestep mode
+    float unsimulatedTime = 0.0f;
+
+    //Steps since the moving circles were last put in Morton order, with options.reorderInterval set
+    uint32_t stepsSinceReorder = 0;
+
+    //Picked by PrepareWorld from the options, the second one writes collision events
+    StepFn step = nullptr;
+    StepFn stepWithEvents = nullptr;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Functions
+//---------------------------------------------------------------------------------------------------------------------
+
+//Creates options.circles random circles, half moving and half stationary, using every scheduler thread. The same options
+//and seed give a bit-identical world on any thread count and platform
+void GenerateWorld(World& world, const SimulationOptions& options, uint32_t seed);
+
+//Walls a tenth outside the bounds circles are generated in
+WorldBounds WallBounds(const SimulationOptions& options);
+
+//One circle's random data, from the Philox bits for (seed, stream, index)
+Circle RandomCircle(const SimulationOptions& options, uint32_t seed, RandomStream stream, uint32_t index);
+CircleVelocity RandomVelocity(uint32_t seed, RandomStream stream, uint32_t index);
+CircleName RandomName(uint32_t seed, RandomStream stream, uint32_t index);
+CircleColourData RandomColour(uint32_t seed, RandomStream stream, uint32_t index);
+
+//Sorts the world in parallel, builds the broad phase structures and picks the step specialisation, call once after GenerateWorld
+void PrepareWorld(World& world);
+
+//Rebuilds what PrepareWorld derives from the world's arrays, for arrays that are already sorted and indexed, e.g. ones
+//restored from a snapshot. Stationary ids, tombstones and queued updates are kept as they are
+void RestoreWorld(World& world);
+
+//Sorts the moving arrays along a Morton curve over the walls, so each chunk covers a compact patch of space and so a
+//compact window of the stationary data. Ids go with their circles, so whatever is indexed by id, like the models, still
+//matches. PrepareWorld and the step call this when options.reorderInterval is set
+void ReorderMovingByMorton(World& world);
+
+//Advances the world by frameTime seconds using every scheduler thread. In fixed timestep mode this is as many whole
+//fixed steps as fit, with the rest carried over to the next call. The same as BeginStep then AdvanceWorld
+void StepSimulation(World& world, float frameTime);
+
+//First part of a StepSimulation: clears the last step's change lists and applies the queued stationary updates. After
+//this nothing changes the stationary circles until the next BeginStep, only their hp, so they can be queried while
+//AdvanceWorld runs
+void BeginStep(World& world);
+
+//Rest of a StepSimulation, moving the world on by frameTime
+void AdvanceWorld(World& world, float frameTime);
+
+//Queues a new stationary circle and returns the id it will have. It takes part from the next StepSimulation
+uint32_t QueueStationaryInsert(World& world, const Circle& circle, const CircleName& name, const CircleColourData& colour);
+
+//Queues the removal of a stationary circle by id. Removing one that is already gone, or whose insert is still queued, does nothing
+void QueueStationaryRemove(World& world, uint32_t id);
+
+//Applies every queued insert and removal. StepSimulation does this first, call it directly to see a batch before then
+void ApplyStationaryUpdates(World& world);
+
+// The per-circle kernels, FindStationaryContacts, FindStationaryContactsGrid, ResolveStationaryContacts,
+// CheckWallCollision and FindMovingPairs, are templates on the options in Simulation.cpp, only reached through the step
+// PrepareWorld picks
+void BuildStationaryGrid(uint32_t numStationary, Circle* stationary, const SimulationOptions& options, StationaryGrid& grid);
+void SortMovingByX(uint32_t numMoving, Circle* moving, CircleVelocity* movingVel, int32_t* movingHp, uint32_t* movingId, CircleColourData* movingColour);
+void ResortMovingByX(uint32_t numMoving, Circle* moving, CircleVelocity* movingVel, int32_t* movingHp, uint32_t* movingId, CircleColourData* movingColour);
+void ResolveMovingPairs(const MovingPair* pairs, uint32_t numPairs, Circle* moving, CircleVelocity* movingVel, int32_t* movingHp, const uint32_t* movingId, CollisionEventRing* events);
+uint32_t DeathModel(uint32_t numMoving, const int32_t* movingHp);
+uint32_t RemoveDeadCircles(uint32_t numMoving, Circle* moving, CircleVelocity* movingVel, int32_t* movingHp, uint32_t* movingId, CircleColourData* movingColour, std::vector<uint32_t>& removed);
@@ -0,0 +1,252 @@
+// Snapshot.cpp: World state saved to a binary file and read back through a memory mapping
+
+#include "Snapshot.h"
+#include "MappedFile.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+static const char SNAPSHOT_MAGIC[8] = { 'D', 'O', 'D', 'S', 'N', 'A', 'P', '\0' };
+
+//---------------------------------------------------------------------------------------------------------------------
+// Save
+//---------------------------------------------------------------------------------------------------------------------
+
+struct SectionData
+{
+    const void* data;
+    uint64_t size;
+};
+
+template <typename T, typename Allocator>
+static SectionData Section(const std::vector<T, Allocator>& array, size_t count)
+{
+    return { array.data(), count * sizeof(T) };
+}
+
+bool SaveSnapshot(const World& world, const char* path)
+{
+    SectionData sections[NUM_SNAPSHOT_SECTIONS];
+    sections[SNAPSHOT_MOVING_CIRCLES] = Section(world.movingCircles, world.numMoving);
+    sections[SNAPSHOT_MOVING_VELOCITYS] = Section(world.movingVelocitys, world.numMoving);
+    sections[SNAPSHOT_MOVING_HP] = Section(world.movingHp, world.numMoving);
+    sections[SNAPSHOT_MOVING_IDS] = Section(world.movingIds, world.numMoving);
+    sections[SNAPSHOT_MOVING_COLOURS] = Section(world.movingColours, world.numMoving);
+    sections[SNAPSHOT_MOVING_NAMES] = Section(world.movingNames, world.movingNames.size());
+    sections[SNAPSHOT_STATIONARY_CIRCLES] = Section(world.stationaryCircles, world.numStationary);
+    sections[SNAPSHOT_STATIONARY_HP] = Section(world.stationaryHp, world.numStationary);
+    sections[SNAPSHOT_STATIONARY_IDS] = Section(world.stationaryIds, world.numStationary);
+    sections[SNAPSHOT_STATIONARY_COLOURS] = Section(world.stationaryColours, world.numStationary);
+    sections[SNAPSHOT_STATIONARY_NAMES] = Section(world.stationaryNames, world.stationaryNames.size());
+    sections[SNAPSHOT_STATIONARY_INDEX] = Section(world.stationaryIndex, world.stationaryIndex.size());
+    sections[SNAPSHOT_STATIONARY_INSERTS] = Section(world.stationaryInserts, world.stationaryInserts.size());
+    sections[SNAPSHOT_STATIONARY_REMOVES] = Section(world.stationaryRemoves, world.stationaryRemoves.size());
+
+    const SimulationOptions& options = world.options;
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.headerSize = sizeof(SnapshotHeader);
+    header.circles = options.circles;
+    header.minX = options.minX;
+    header.maxX = options.maxX;
+    header.minY = options.minY;
+    header.maxY = options.maxY;
+    header.fixedTimestep = options.fixedTimestep;
+    header.death = options.death;
+    header.walls = options.walls;
+    header.movingCollisions = options.movingCollisions;
+    header.randRadius = options.randRadius;
+    header.minRadius = options.minRadius;
+    header.maxRadius = options.maxRadius;
+    header.radius = options.radius;
+    header.broadPhase = static_cast<uint32_t>(options.broadPhase);
+    header.bounds = world.walls;
+    header.numMoving = world.numMoving;
+    header.numStationary = world.numStationary;
+    header.numTombstones = world.numTombstones;
+    header.unsimulatedTime = world.unsimulatedTime;
+
+    uint64_t offset = sizeof(SnapshotHeader);
+    for (uint32_t i = 0; i < NUM_SNAPSHOT_SECTIONS; ++i)
+    {
+        offset = (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+        header.sections[i].offset = offset;
+        header.sections[i].size = sections[i].size;
+        offset += sections[i].size;
+    }
+
+    std::FILE* file = std::fopen(path, "wb");
+    if (!file)
+    {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+
+    static const char padding[SNAPSHOT_ALIGNMENT] = {};
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    offset = sizeof(SnapshotHeader);
+    for (uint32_t i = 0; i < NUM_SNAPSHOT_SECTIONS && written; ++i)
+    {
+        uint64_t pad = header.sections[i].offset - offset;
+        //An empty array can have no data, which fwrite must not be given
+        written = std::fwrite(padding, 1, pad, file) == pad
+            && (sections[i].size == 0 || std::fwrite(sections[i].data, 1, sections[i].size, file) == sections[i].size);
+        offset = header.sections[i].offset + sections[i].size;
+    }
+    written = std::fclose(file) == 0 && written;
+    if (!written)
+    {
+        std::cout << "Could not write " << path << std::endl;
+    }
+    return written;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Load
+//---------------------------------------------------------------------------------------------------------------------
+
+//Copies a section into array, which gets size / sizeof(T) elements. Returns false if the section is not a whole number of them.
+//The copy is spread over the scheduler threads in ParallelFor chunks, so each chunk's pages are placed by the thread that
+//will step it
+template <typename T, typename Allocator>
+static bool LoadSection(const MappedFile& mapped, const SnapshotHeader& header, SnapshotSectionId id, std::vector<T, Allocator>& array)
+{
+    const SnapshotSection& section = header.sections[id];
+    if (section.size % sizeof(T) != 0 || section.size / sizeof(T) > UINT32_MAX)
+    {
+        return false;
+    }
+    uint32_t count = static_cast<uint32_t>(section.size / sizeof(T));
+    array.resize(count);
+    const uint8_t* data = mapped.data + section.offset;
+    ParallelFor(0, count, CHUNK_SIZE, [&](uint32_t chunkBegin, uint32_t chunkEnd, uint32_t thread)
+    {
+        std::memcpy(array.data() + chunkBegin, data + static_cast<uint64_t>(chunkBegin) * sizeof(T), (chunkEnd - chunkBegin) * sizeof(T));
+    });
+    return true;
+}
+
+//Checks the ids tie the arrays together, so a damaged file can't index out of bounds once stepping
+static bool SnapshotIdsValid(const World& world)
+{
+    uint32_t numStationaryIds = static_cast<uint32_t>(world.stationaryIndex.size());
+    if (world.stationaryNames.size() != numStationaryIds)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < world.numMoving; ++i)
+    {
+        if (world.movingIds[i] >= world.movingNames.size())
+        {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < world.numStationary; ++i)
+    {
+        if (world.stationaryIds[i] >= numStationaryIds)
+        {
+            return false;
+        }
+    }
+    for (uint32_t index : world.stationaryIndex)
+    {
+        if (index != NO_STATIONARY && index >= world.numStationary)
+        {
+            return false;
+        }
+    }
+    for (auto& insert : world.stationaryInserts)
+    {
+        if (insert.id >= numStationaryIds)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LoadSnapshot(World& world, const SimulationOptions& options, const char* path)
+{
+    MappedFile mapped;
+    if (!MapFile(mapped, path))
+    {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+
+    SnapshotHeader header;
+    bool valid = mapped.size >= sizeof(header);
+    if (valid)
+    {
+        std::memcpy(&header, mapped.data, sizeof(header));
+        valid = std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0;
+    }
+    if (!valid || header.version != SNAPSHOT_VERSION || header.headerSize != sizeof(SnapshotHeader))
+    {
+        std::cout << path << " is not a version " << SNAPSHOT_VERSION << " snapshot" << std::endl;
+        UnmapFile(mapped);
+        return false;
+    }
+    for (uint32_t i = 0; i < NUM_SNAPSHOT_SECTIONS && valid; ++i)
+    {
+        const SnapshotSection& section = header.sections[i];
+        valid = section.offset % SNAPSHOT_ALIGNMENT == 0 && section.offset <= mapped.size && section.size <= mapped.size - section.offset;
+    }
+
+    World loaded;
+    loaded.options = options;
+    loaded.options.circles = header.circles;
+    loaded.options.minX = header.minX;
+    loaded.options.maxX = header.maxX;
+    loaded.options.minY = header.minY;
+    loaded.options.maxY = header.maxY;
+    loaded.options.fixedTimestep = header.fixedTimestep;
+    loaded.options.death = header.death != 0;
+    loaded.options.walls = header.walls != 0;
+    loaded.options.movingCollisions = header.movingCollisions != 0;
+    loaded.options.randRadius = header.randRadius != 0;
+    loaded.options.minRadius = header.minRadius;
+    loaded.options.maxRadius = header.maxRadius;
+    loaded.options.radius = header.radius;
+    loaded.options.broadPhase = static_cast<BroadPhase>(header.broadPhase);
+    loaded.walls = header.bounds;
+    loaded.numMoving = header.numMoving;
+    loaded.numStationary = header.numStationary;
+    loaded.numTombstones = header.numTombstones;
+    loaded.unsimulatedTime = header.unsimulatedTime;
+
+    valid = valid && header.broadPhase <= static_cast<uint32_t>(BroadPhase::Grid)
+        && LoadSection(mapped, header, SNAPSHOT_MOVING_CIRCLES, loaded.movingCircles)
+        && LoadSection(mapped, header, SNAPSHOT_MOVING_VELOCITYS, loaded.movingVelocitys)
+        && LoadSection(mapped, header, SNAPSHOT_MOVING_HP, loaded.movingHp)
+        && LoadSection(mapped, header, SNAPSHOT_MOVING_IDS, loaded.movingIds)
+        && LoadSection(mapped, header, SNAPSHOT_MOVING_COLOURS, loaded.movingColours)
+        && LoadSection(mapped, header, SNAPSHOT_MOVING_NAMES, loaded.movingNames)
+        && LoadSection(mapped, header, SNAPSHOT_STATIONARY_CIRCLES, loaded.stationaryCircles)
+        && LoadSection(mapped, header, SNAPSHOT_STATIONARY_HP, loaded.stationaryHp)
+        && LoadSection(mapped, header, SNAPSHOT_STATIONARY_IDS, loaded.stationaryIds)
+        && LoadSection(mapped, header, SNAPSHOT_STATIONARY_COLOURS, loaded.stationaryColours)
+        && LoadSection(mapped, header, SNAPSHOT_STATIONARY_NAMES, loaded.stationaryNames)
+        && LoadSection(mapped, header, SNAPSHOT_STATIONARY_INDEX, loaded.stationaryIndex)
+        && LoadSection(mapped, header, SNAPSHOT_STATIONARY_INSERTS, loaded.stationaryInserts)
+        && LoadSection(mapped, header, SNAPSHOT_STATIONARY_REMOVES, loaded.stationaryRemoves);
+    UnmapFile(mapped);
+
+    valid = valid
+        && loaded.movingCircles.size() == loaded.numMoving && loaded.movingVelocitys.size() == loaded.numMoving
+        && loaded.movingHp.size() == loaded.numMoving && loaded.movingIds.size() == loaded.numMoving
+        && loaded.movingColours.size() == loaded.numMoving
+        && loaded.stationaryCircles.size() == loaded.numStationary && loaded.stationaryHp.size() == loaded.numStationary
+        && loaded.stationaryIds.size() == loaded.numStationary && loaded.stationaryColours.size() == loaded.numStationary
+        && SnapshotIdsValid(loaded) && ValidateOptions(loaded.options);
+    if (!valid)
+    {
+        std::cout << path << " is damaged" << std::endl;
+        return false;
+    }
+
+    world = std::move(loaded);
+    RestoreWorld(world);
+    return true;
+}
@@ -0,0 +1,86 @@
+// Snapshot.h: World state saved to a binary file and read back through a memory mapping
+#pragma once
+
+#include "Simulation.h"
+#include <cstdint>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Snapshot Format
+//---------------------------------------------------------------------------------------------------------------------
+
+// A snapshot is a SnapshotHeader followed by one section per world array, each the raw array in native byte order and
+// starting on a SNAPSHOT_ALIGNMENT byte boundary. Arrays are saved as the step left them, so the stationary set is
+// already sorted, tombstones and queued updates included, and a restored world carries on exactly as the saved one would.
+// Loading maps the file read-only and copies each section into its array whole, with no generation, sorting or per-element
+// work. The world owns its arrays, so this is one bulk copy out of the mapping, not a load in place
+
+const uint32_t SNAPSHOT_VERSION = 1;
+const uint32_t SNAPSHOT_ALIGNMENT = 64;
+
+enum SnapshotSectionId : uint32_t
+{
+    SNAPSHOT_MOVING_CIRCLES,
+    SNAPSHOT_MOVING_VELOCITYS,
+    SNAPSHOT_MOVING_HP,
+    SNAPSHOT_MOVING_IDS,
+    SNAPSHOT_MOVING_COLOURS,
+    SNAPSHOT_MOVING_NAMES,
+    SNAPSHOT_STATIONARY_CIRCLES,
+    SNAPSHOT_STATIONARY_HP,
+    SNAPSHOT_STATIONARY_IDS,
+    SNAPSHOT_STATIONARY_COLOURS,
+    SNAPSHOT_STATIONARY_NAMES,
+    SNAPSHOT_STATIONARY_INDEX,
+    SNAPSHOT_STATIONARY_INSERTS,
+    SNAPSHOT_STATIONARY_REMOVES,
+    NUM_SNAPSHOT_SECTIONS
+};
+
+//Where a section is in the file, in bytes
+struct SnapshotSection
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Scenario options are saved with the world they made, the rest, e.g. the SIMD level and log, are the loader's choice
+struct alignas(64) SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+
+    uint32_t circles;
+    int32_t minX;
+    int32_t maxX;
+    int32_t minY;
+    int32_t maxY;
+    float fixedTimestep;
+    uint8_t death;
+    uint8_t walls;
+    uint8_t movingCollisions;
+    uint8_t randRadius;
+    int32_t minRadius;
+    int32_t maxRadius;
+    float radius;
+    uint32_t broadPhase;
+
+    WorldBounds bounds;
+    uint32_t numMoving;
+    uint32_t numStationary;
+    uint32_t numTombstones;
+    float unsimulatedTime;
+
+    SnapshotSection sections[NUM_SNAPSHOT_SECTIONS];
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Functions
+//---------------------------------------------------------------------------------------------------------------------
+
+//Writes the world to path. Call between steps, e.g. after FinishStep. Returns false, after saying why, if it can't be written
+bool SaveSnapshot(const World& world, const char* path);
+
+//Replaces the world with the one saved in path, ready to step, in place of GenerateWorld and PrepareWorld. The scenario
+//options come from the snapshot and everything else from options. Returns false, after saying why, if the file can't be used
+bool LoadSnapshot(World& world, const SimulationOptions& options, const char* path);
@@ -0,0 +1,625 @@
+// Trajectory.cpp: Moving circle positions streamed to disk each frame, and read back for replay
+
+#include "Trajectory.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+static const char TRAJECTORY_MAGIC[8] = { 'D', 'O', 'D', 'T', 'R', 'A', 'J', '\0' };
+
+//Position in whole quanta, clamped so a circle flung far outside the world can't overflow. The quantum is a power of two,
+//so the divide is exact as a multiply. Rounded by truncating and stepping down below zero, as std::floor is a library
+//call without SSE4.1
+static int32_t Quantise(float value)
+{
+    float quanta = value * (1.0f / TRAJECTORY_QUANTUM) + 0.5f;
+    quanta = std::max(quanta, -2147483520.0f);
+    quanta = std::min(quanta, 2147483520.0f); //Largest float below 2^31
+    int32_t truncated = static_cast<int32_t>(quanta);
+    return truncated - (quanta < static_cast<float>(truncated));
+}
+
+//Signed change folded so small changes either way are small numbers, 0, -1, 1, -2 becoming 0, 1, 2, 3. Done on the
+//wrapped 32 bit difference, which decoding wraps back the same way
+static uint32_t ZigZag(int32_t value, int32_t last)
+{
+    uint32_t delta = static_cast<uint32_t>(value) - static_cast<uint32_t>(last);
+    return (delta << 1) ^ (0u - (delta >> 31));
+}
+
+static uint32_t UnZigZag(uint32_t value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+static uint32_t PackedSize(uint32_t count, uint32_t width)
+{
+    return (count * width + 7) / 8;
+}
+
+//Bytes a packed block can need at most, with room for UnpackBits to read a whole 32 bit word past the end
+const uint32_t PACKED_BLOCK_SIZE = TRAJECTORY_BLOCK * sizeof(uint32_t) + sizeof(uint32_t);
+
+static void Store32(uint8_t* out, uint32_t value)
+{
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    out[2] = static_cast<uint8_t>(value >> 16);
+    out[3] = static_cast<uint8_t>(value >> 24);
+}
+
+static uint32_t Load32(const uint8_t* in)
+{
+    return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+// Values are packed least significant bit first, in a 64 bit accumulator emptied 32 bits at a time so it never overflows
+
+//Writes count values of width bits and returns the end of them. out must have room for PackedSize(count, width) bytes
+static uint8_t* PackBits(uint8_t* out, const uint32_t* values, uint32_t count, uint32_t width)
+{
+    uint64_t bits = 0;
+    uint32_t numBits = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        bits |= static_cast<uint64_t>(values[i]) << numBits;
+        numBits += width;
+        if (numBits >= 32)
+        {
+            Store32(out, static_cast<uint32_t>(bits));
+            out += 4;
+            bits >>= 32;
+            numBits -= 32;
+        }
+    }
+    for (; numBits > 0; numBits -= std::min(numBits, 8u))
+    {
+        *out++ = static_cast<uint8_t>(bits);
+        bits >>= 8;
+    }
+    return out;
+}
+
+//Reads back count values PackBits wrote. in must hold PackedSize(count, width) bytes, and is copied so the last word
+//read can run past them
+static void UnpackBits(const uint8_t* in, uint32_t* values, uint32_t count, uint32_t width)
+{
+    uint8_t padded[PACKED_BLOCK_SIZE] = {};
+    std::memcpy(padded, in, PackedSize(count, width));
+    const uint8_t* word = padded;
+    uint64_t mask = (1ull << width) - 1;
+    uint64_t bits = 0;
+    uint32_t numBits = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (numBits < width)
+        {
+            bits |= static_cast<uint64_t>(Load32(word)) << numBits;
+            word += 4;
+            numBits += 32;
+        }
+        values[i] = static_cast<uint32_t>(bits & mask);
+        bits >>= width;
+        numBits -= width;
+    }
+}
+
+static bool IsAlive(const std::vector<uint64_t>& alive, uint32_t id)
+{
+    return (alive[id / 64] >> (id % 64)) & 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Recorder
+//---------------------------------------------------------------------------------------------------------------------
+
+//Writes size bytes, returns false if they weren't all written. Nothing is passed to fwrite when size is 0, as an empty
+//vector's data can be null
+static bool WriteBytes(const void* data, size_t size, std::FILE* file)
+{
+    return size == 0 || std::fwrite(data, 1, size, file) == size;
+}
+
+static void Append(std::vector<uint8_t>& out, const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+//Encodes one axis of a delta frame, a block at a time, and moves last on to the frame's positions. out must have room
+//for a width byte and PACKED_BLOCK_SIZE bytes per block. Returns the end of what was written
+static uint8_t* EncodeDeltas(uint8_t* out, const int32_t* position, int32_t* last, uint32_t numIds)
+{
+    uint32_t deltas[TRAJECTORY_BLOCK];
+    for (uint32_t blockStart = 0; blockStart < numIds; blockStart += TRAJECTORY_BLOCK)
+    {
+        uint32_t count = std::min(TRAJECTORY_BLOCK, numIds - blockStart);
+        uint32_t largest = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t id = blockStart + i;
+            deltas[i] = ZigZag(position[id], last[id]);
+            largest |= deltas[i];
+            last[id] = position[id];
+        }
+
+        uint8_t width = 0;
+        while (width < 32 && (largest >> width) != 0)
+        {
+            ++width;
+        }
+        *out++ = width;
+        out = PackBits(out, deltas, count, width);
+    }
+    return out;
+}
+
+static void WriteFrame(TrajectoryRecorder& recorder, const TrajectoryPendingFrame& pending)
+{
+    uint32_t numIds = recorder.numIds;
+    int32_t* x = recorder.x.data();
+    int32_t* y = recorder.y.data();
+
+    // Dead circles aren't in the frame, so keep their last position and encode as no change
+    uint32_t numMoving = static_cast<uint32_t>(pending.ids.size());
+    const Circle* moving = pending.circles.data();
+    const uint32_t* movingId = pending.ids.data();
+    for (uint32_t i = 0; i < numMoving; ++i)
+    {
+        x[movingId[i]] = Quantise(moving[i].x);
+        y[movingId[i]] = Quantise(moving[i].y);
+    }
+
+    TrajectoryFrameHeader header;
+    header.frame = recorder.numFrames;
+    header.keyframe = recorder.numFrames % TRAJECTORY_KEYFRAME_INTERVAL == 0;
+    header.numRemoved = static_cast<uint32_t>(pending.removed.size());
+
+    std::vector<uint8_t>& payload = recorder.payload;
+    payload.clear();
+    if (header.keyframe)
+    {
+        std::fill(recorder.alive.begin(), recorder.alive.end(), 0);
+        for (uint32_t i = 0; i < numMoving; ++i)
+        {
+            recorder.alive[movingId[i] / 64] |= 1ull << (movingId[i] % 64);
+        }
+        recorder.keyframes.push_back({ recorder.numFrames, 0, recorder.offset });
+        Append(payload, recorder.alive.data(), recorder.alive.size() * sizeof(uint64_t));
+        Append(payload, x, numIds * sizeof(int32_t));
+        Append(payload, y, numIds * sizeof(int32_t));
+        std::copy(x, x + numIds, recorder.lastX.begin());
+        std::copy(y, y + numIds, recorder.lastY.begin());
+    }
+    else
+    {
+        uint32_t numBlocks = (numIds + TRAJECTORY_BLOCK - 1) / TRAJECTORY_BLOCK;
+        payload.resize(2 * numBlocks * (1 + PACKED_BLOCK_SIZE));
+        uint8_t* end = EncodeDeltas(payload.data(), x, recorder.lastX.data(), numIds);
+        end = EncodeDeltas(end, y, recorder.lastY.data(), numIds);
+        payload.resize(end - payload.data());
+    }
+    header.payloadSize = static_cast<uint32_t>(payload.size());
+
+    if (!recorder.failed)
+    {
+        size_t removedSize = pending.removed.size() * sizeof(uint32_t);
+        recorder.failed = std::fwrite(&header, sizeof(header), 1, recorder.file) != 1
+            || !WriteBytes(pending.removed.data(), removedSize, recorder.file)
+            || !WriteBytes(payload.data(), payload.size(), recorder.file);
+        recorder.offset += sizeof(header) + removedSize + payload.size();
+    }
+    ++recorder.numFrames;
+}
+
+//*********************************************************
+// The trajectory writer thread runs this method
+// It sleeps until a frame is queued, encodes and writes it, then frees its slot. Once stopping it drains the queue first
+static void TrajectoryThread(TrajectoryRecorder* recorder)
+{
+    while (true)
+    {
+        uint32_t slot;
+        {
+            std::unique_lock<std::mutex> l(recorder->lock);
+            recorder->frameReady.wait(l, [&]() { return recorder->head != recorder->tail || recorder->stopping; });
+            if (recorder->head == recorder->tail)
+            {
+                return;
+            }
+            slot = recorder->tail % TRAJECTORY_QUEUE;
+        }
+
+        WriteFrame(*recorder, recorder->pending[slot]);
+
+        {
+            std::unique_lock<std::mutex> l(recorder->lock);
+            ++recorder->tail;
+        }
+        recorder->frameDone.notify_one();
+    }
+}
+
+bool StartTrajectoryRecorder(TrajectoryRecorder& recorder, const char* path, const World& world)
+{
+    recorder.file = std::fopen(path, "wb");
+    if (!recorder.file)
+    {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+
+    // Moving ids are never added to, so the id count is fixed for the whole recording
+    uint32_t numIds = static_cast<uint32_t>(world.movingNames.size());
+    recorder.numIds = numIds;
+    std::vector<float> radii(numIds, 0.0f);
+    for (uint32_t i = 0; i < world.numMoving; ++i)
+    {
+        radii[world.movingIds[i]] = world.movingCircles[i].rad;
+    }
+
+    TrajectoryHeader header;
+    std::memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic));
+    header.version = TRAJECTORY_VERSION;
+    header.numIds = numIds;
+    header.quantum = TRAJECTORY_QUANTUM;
+    header.keyframeInterval = TRAJECTORY_KEYFRAME_INTERVAL;
+    if (std::fwrite(&header, sizeof(header), 1, recorder.file) != 1 || !WriteBytes(radii.data(), numIds * sizeof(float), recorder.file))
+    {
+        std::cout << "Could not write " << path << std::endl;
+        std::fclose(recorder.file);
+        recorder.file = nullptr;
+        return false;
+    }
+    recorder.offset = sizeof(header) + numIds * sizeof(float);
+
+    for (auto& pending : recorder.pending)
+    {
+        pending.circles.reserve(world.numMoving);
+        pending.ids.reserve(world.numMoving);
+    }
+    recorder.x.assign(numIds, 0);
+    recorder.y.assign(numIds, 0);
+    recorder.lastX.assign(numIds, 0);
+    recorder.lastY.assign(numIds, 0);
+    recorder.alive.assign((numIds + 63) / 64, 0);
+    recorder.keyframes.clear();
+    recorder.numFrames = 0;
+    recorder.head = 0;
+    recorder.tail = 0;
+    recorder.stopping = false;
+    recorder.failed = false;
+    recorder.thread = std::thread(&TrajectoryThread, &recorder);
+    return true;
+}
+
+void RecordTrajectoryFrame(TrajectoryRecorder& recorder, const FrameState& frame)
+{
+    uint32_t slot;
+    {
+        std::unique_lock<std::mutex> l(recorder.lock);
+        recorder.frameDone.wait(l, [&]() { return recorder.head - recorder.tail < TRAJECTORY_QUEUE; });
+        slot = recorder.head % TRAJECTORY_QUEUE;
+    }
+
+    // The writer only touches slots from tail to head, so this one is ours until head moves past it
+    TrajectoryPendingFrame& pending = recorder.pending[slot];
+    pending.circles.assign(frame.movingCircles.begin(), frame.movingCircles.begin() + frame.numMoving);
+    pending.ids.assign(frame.movingIds.begin(), frame.movingIds.begin() + frame.numMoving);
+    pending.removed = frame.removedMoving;
+
+    {
+        std::unique_lock<std::mutex> l(recorder.lock);
+        ++recorder.head;
+    }
+    recorder.frameReady.notify_one();
+}
+
+bool StopTrajectoryRecorder(TrajectoryRecorder& recorder)
+{
+    if (!recorder.file)
+    {
+        return false;
+    }
+
+    {
+        std::unique_lock<std::mutex> l(recorder.lock);
+        recorder.stopping = true;
+    }
+    recorder.frameReady.notify_one();
+    recorder.thread.join();
+
+    TrajectoryTrailer trailer;
+    trailer.indexOffset = recorder.offset;
+    trailer.numKeyframes = static_cast<uint32_t>(recorder.keyframes.size());
+    trailer.numFrames = recorder.numFrames;
+    std::memcpy(trailer.magic, TRAJECTORY_MAGIC, sizeof(trailer.magic));
+    bool written = !recorder.failed
+        && WriteBytes(recorder.keyframes.data(), recorder.keyframes.size() * sizeof(TrajectoryKeyframe), recorder.file)
+        && std::fwrite(&trailer, sizeof(trailer), 1, recorder.file) == 1;
+    written = std::fclose(recorder.file) == 0 && written;
+    recorder.file = nullptr;
+    if (!written)
+    {
+        std::cout << "Could not write the trajectory" << std::endl;
+    }
+    return written;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Reader
+//---------------------------------------------------------------------------------------------------------------------
+
+//Offset of the first frame, just past the header and radii
+static uint64_t FramesStart(const TrajectoryReader& reader)
+{
+    return sizeof(TrajectoryHeader) + static_cast<uint64_t>(reader.header.numIds) * sizeof(float);
+}
+
+//Reads the header of the frame at offset, returns false if it, its removed ids or its payload run past end
+static bool ReadFrameHeader(const TrajectoryReader& reader, uint64_t offset, uint64_t end, TrajectoryFrameHeader& header)
+{
+    if (offset > end || end - offset < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, reader.mapped.data + offset, sizeof(header));
+    uint64_t size = static_cast<uint64_t>(header.numRemoved) * sizeof(uint32_t) + header.payloadSize;
+    return size <= end - offset - sizeof(header);
+}
+
+//Loads the keyframe index from the trailer, returns false if there isn't a whole one
+static bool ReadTrailer(TrajectoryReader& reader)
+{
+    const MappedFile& mapped = reader.mapped;
+    uint64_t framesStart = FramesStart(reader);
+    TrajectoryTrailer trailer;
+    if (mapped.size < framesStart + sizeof(trailer))
+    {
+        return false;
+    }
+    std::memcpy(&trailer, mapped.data + mapped.size - sizeof(trailer), sizeof(trailer));
+    uint64_t indexEnd = mapped.size - sizeof(trailer);
+    if (std::memcmp(trailer.magic, TRAJECTORY_MAGIC, sizeof(trailer.magic)) != 0 || trailer.indexOffset < framesStart
+        || trailer.indexOffset > indexEnd || (indexEnd - trailer.indexOffset) != static_cast<uint64_t>(trailer.numKeyframes) * sizeof(TrajectoryKeyframe))
+    {
+        return false;
+    }
+
+    reader.keyframes.resize(trailer.numKeyframes);
+    std::memcpy(reader.keyframes.data(), mapped.data + trailer.indexOffset, trailer.numKeyframes * sizeof(TrajectoryKeyframe));
+    reader.numFrames = trailer.numFrames;
+    reader.framesEnd = trailer.indexOffset;
+    return true;
+}
+
+//Finds the keyframes of a file the recorder never finished by walking its frames, stopping at the first one cut short
+static void ScanFrames(TrajectoryReader& reader)
+{
+    reader.keyframes.clear();
+    reader.numFrames = 0;
+    uint64_t offset = FramesStart(reader);
+    TrajectoryFrameHeader header;
+    while (ReadFrameHeader(reader, offset, reader.mapped.size, header) && header.frame == reader.numFrames)
+    {
+        if (header.keyframe)
+        {
+            reader.keyframes.push_back({ header.frame, 0, offset });
+        }
+        offset += sizeof(header) + static_cast<uint64_t>(header.numRemoved) * sizeof(uint32_t) + header.payloadSize;
+        ++reader.numFrames;
+    }
+    reader.framesEnd = offset;
+}
+
+bool OpenTrajectory(TrajectoryReader& reader, const char* path)
+{
+    if (!MapFile(reader.mapped, path))
+    {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+
+    const MappedFile& mapped = reader.mapped;
+    bool valid = mapped.size >= sizeof(TrajectoryHeader);
+    if (valid)
+    {
+        std::memcpy(&reader.header, mapped.data, sizeof(TrajectoryHeader));
+        valid = std::memcmp(reader.header.magic, TRAJECTORY_MAGIC, sizeof(reader.header.magic)) == 0
+            && reader.header.version == TRAJECTORY_VERSION && reader.header.quantum > 0.0f;
+    }
+    if (!valid || mapped.size < FramesStart(reader))
+    {
+        std::cout << path << " is not a version " << TRAJECTORY_VERSION << " trajectory" << std::endl;
+        UnmapFile(reader.mapped);
+        return false;
+    }
+
+    uint32_t numIds = reader.header.numIds;
+    reader.radii.resize(numIds);
+    std::memcpy(reader.radii.data(), mapped.data + sizeof(TrajectoryHeader), numIds * sizeof(float));
+    if (!ReadTrailer(reader))
+    {
+        ScanFrames(reader);
+    }
+    if (reader.keyframes.empty() || reader.keyframes[0].frame != 0)
+    {
+        std::cout << path << " has no frames" << std::endl;
+        UnmapFile(reader.mapped);
+        return false;
+    }
+
+    reader.x.assign(numIds, 0);
+    reader.y.assign(numIds, 0);
+    reader.alive.assign((numIds + 63) / 64, 0);
+    reader.moved.assign(numIds, 0);
+    reader.offset = reader.keyframes[0].offset;
+    reader.frame = 0;
+    reader.seeked = false;
+    return true;
+}
+
+//Decodes one axis of a delta frame from in, which holds size bytes, and marks the circles it moves. Returns false if
+//the blocks don't fill exactly size bytes
+static bool DecodeDeltas(const uint8_t*& in, uint64_t& size, int32_t* position, uint8_t* moved, uint32_t numIds)
+{
+    uint32_t deltas[TRAJECTORY_BLOCK];
+    for (uint32_t blockStart = 0; blockStart < numIds; blockStart += TRAJECTORY_BLOCK)
+    {
+        uint32_t count = std::min(TRAJECTORY_BLOCK, numIds - blockStart);
+        if (size < 1 || in[0] > 32 || size - 1 < PackedSize(count, in[0]))
+        {
+            return false;
+        }
+        uint32_t width = in[0];
+        in += 1;
+        size -= 1;
+        if (width == 0)
+        {
+            continue; // Nothing in the block moved
+        }
+        UnpackBits(in, deltas, count, width);
+        in += PackedSize(count, width);
+        size -= PackedSize(count, width);
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t id = blockStart + i;
+            uint32_t delta = UnZigZag(deltas[i]);
+            position[id] = static_cast<int32_t>(static_cast<uint32_t>(position[id]) + delta);
+            moved[id] |= delta != 0;
+        }
+    }
+    return true;
+}
+
+//Applies the next frame to the reader's positions and, if given one, fills frame from them. Returns false at the end or if
+//the frame is damaged, after saying so
+static bool DecodeFrame(TrajectoryReader& reader, FrameState* frame)
+{
+    if (reader.frame >= reader.numFrames)
+    {
+        return false;
+    }
+
+    uint32_t numIds = reader.header.numIds;
+    uint64_t aliveSize = reader.alive.size() * sizeof(uint64_t);
+    TrajectoryFrameHeader header = {};
+    bool valid = ReadFrameHeader(reader, reader.offset, reader.framesEnd, header) && header.frame == reader.frame
+        && (!header.keyframe || header.payloadSize == aliveSize + 2ull * numIds * sizeof(int32_t));
+    const uint8_t* removed = reader.mapped.data + reader.offset + sizeof(header);
+    const uint8_t* payload = removed + header.numRemoved * sizeof(uint32_t);
+
+    std::fill(reader.moved.begin(), reader.moved.end(), reader.seeked || header.keyframe);
+    for (uint32_t i = 0; i < header.numRemoved && valid; ++i)
+    {
+        uint32_t id;
+        std::memcpy(&id, removed + i * sizeof(uint32_t), sizeof(id));
+        valid = id < numIds;
+        if (valid)
+        {
+            reader.alive[id / 64] &= ~(1ull << (id % 64));
+        }
+    }
+
+    if (valid && header.keyframe)
+    {
+        std::memcpy(reader.alive.data(), payload, aliveSize);
+        std::memcpy(reader.x.data(), payload + aliveSize, numIds * sizeof(int32_t));
+        std::memcpy(reader.y.data(), payload + aliveSize + numIds * sizeof(int32_t), numIds * sizeof(int32_t));
+    }
+    else if (valid)
+    {
+        uint64_t size = header.payloadSize;
+        valid = DecodeDeltas(payload, size, reader.x.data(), reader.moved.data(), numIds)
+            && DecodeDeltas(payload, size, reader.y.data(), reader.moved.data(), numIds) && size == 0;
+    }
+    if (!valid)
+    {
+        std::cout << "Trajectory frame " << reader.frame << " is damaged" << std::endl;
+        reader.frame = reader.numFrames;
+        return false;
+    }
+
+    reader.offset += sizeof(header) + header.numRemoved * sizeof(uint32_t) + header.payloadSize;
+    ++reader.frame;
+    if (!frame)
+    {
+        return true;
+    }
+    reader.seeked = false;
+
+    frame->movingCircles.resize(numIds);
+    frame->movingIds.resize(numIds);
+    frame->changed.assign((numIds + 63) / 64, 0);
+    Circle* moving = frame->movingCircles.data();
+    uint32_t* movingId = frame->movingIds.data();
+    uint64_t* changed = frame->changed.data();
+    const float* radii = reader.radii.data();
+    const int32_t* x = reader.x.data();
+    const int32_t* y = reader.y.data();
+    const uint8_t* moved = reader.moved.data();
+    float quantum = reader.header.quantum;
+    uint32_t numMoving = 0;
+    for (uint32_t id = 0; id < numIds; ++id)
+    {
+        if (IsAlive(reader.alive, id))
+        {
+            moving[numMoving] = { radii[id], x[id] * quantum, y[id] * quantum };
+            movingId[numMoving] = id;
+            changed[numMoving / 64] |= static_cast<uint64_t>(moved[id]) << (numMoving % 64);
+            ++numMoving;
+        }
+    }
+    frame->numMoving = numMoving;
+    frame->movingCircles.resize(numMoving);
+    frame->movingIds.resize(numMoving);
+    frame->changed.resize((numMoving + 63) / 64);
+
+    frame->removedMoving.resize(header.numRemoved);
+    if (header.numRemoved > 0)
+    {
+        std::memcpy(frame->removedMoving.data(), removed, header.numRemoved * sizeof(uint32_t));
+    }
+    frame->numStationaryIds = 0;
+    frame->removedStationary.clear();
+    frame->insertedStationary.clear();
+    frame->insertedCircles.clear();
+    return true;
+}
+
+bool ReadTrajectoryFrame(TrajectoryReader& reader, FrameState& frame)
+{
+    return DecodeFrame(reader, &frame);
+}
+
+bool SeekTrajectory(TrajectoryReader& reader, uint32_t frame)
+{
+    if (frame >= reader.numFrames)
+    {
+        return false;
+    }
+
+    // Keyframes are in frame order, the first at frame 0
+    auto keyframe = std::upper_bound(reader.keyframes.begin(), reader.keyframes.end(), frame,
+        [](uint32_t frame, const TrajectoryKeyframe& keyframe) { return frame < keyframe.frame; }) - 1;
+    reader.offset = keyframe->offset;
+    reader.frame = keyframe->frame;
+    while (reader.frame < frame)
+    {
+        if (!DecodeFrame(reader, nullptr))
+        {
+            return false;
+        }
+    }
+    reader.seeked = true;
+    return true;
+}
+
+void CloseTrajectory(TrajectoryReader& reader)
+{
+    UnmapFile(reader.mapped);
+    reader.keyframes.clear();
+    reader.numFrames = 0;
+}
@@ -0,0 +1,153 @@
+// Trajectory.h: Moving circle positions streamed to disk each frame, and read back for replay
+#pragma once
+
+#include "Pipeline.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Trajectory Format
+//---------------------------------------------------------------------------------------------------------------------
+
+// A TrajectoryHeader, then the radius of every moving id, then one record per frame. Positions are kept per id, quantised
+// to TRAJECTORY_QUANTUM. Every TRAJECTORY_KEYFRAME_INTERVAL frames is a keyframe holding the live ids as a bit mask and
+// every position raw. The frames between hold each position's change from the frame before, zigzag encoded and
+// bit-packed per axis in blocks of TRAJECTORY_BLOCK ids at the width the block's largest change needs, so a block of
+// still or dead circles is one byte per axis. A finished file ends with an index of the keyframes and a trailer, a file
+// cut short is scanned for them instead. Everything is in native byte order, as with snapshots
+
+const uint32_t TRAJECTORY_VERSION = 1;
+const float TRAJECTORY_QUANTUM = 1.0f / 1024.0f;    //World units per step of a quantised position, a power of two so it is exact
+const uint32_t TRAJECTORY_KEYFRAME_INTERVAL = 60;   //Frames from one keyframe to the next, the most decoded to seek
+const uint32_t TRAJECTORY_BLOCK = 64;               //Ids sharing a bit width
+const uint32_t TRAJECTORY_QUEUE = 4;                //Frames waiting to be written before recording waits for the writer
+
+struct TrajectoryHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t numIds;
+    float quantum;
+    uint32_t keyframeInterval;
+};
+
+struct TrajectoryFrameHeader
+{
+    uint32_t frame;
+    uint32_t keyframe;    //1 for a keyframe
+    uint32_t numRemoved;  //Ids that died since the frame before, listed after this header
+    uint32_t payloadSize; //Bytes of positions after the removed ids
+};
+
+struct TrajectoryKeyframe
+{
+    uint32_t frame;
+    uint32_t padding;
+    uint64_t offset; //Of the frame's TrajectoryFrameHeader
+};
+
+struct TrajectoryTrailer
+{
+    uint64_t indexOffset; //Of numKeyframes TrajectoryKeyframes
+    uint32_t numKeyframes;
+    uint32_t numFrames;
+    char magic[8];
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Recorder
+//---------------------------------------------------------------------------------------------------------------------
+
+// RecordTrajectoryFrame only copies the frame's moving circles into a queue, a writer thread does the quantising, encoding
+// and I/O. If the writer falls TRAJECTORY_QUEUE frames behind, recording waits for it rather than dropping a frame
+
+//A frame waiting to be written, as the FrameState had it
+struct TrajectoryPendingFrame
+{
+    std::vector<Circle> circles;
+    std::vector<uint32_t> ids;
+    std::vector<uint32_t> removed;
+};
+
+struct TrajectoryRecorder
+{
+    std::FILE* file = nullptr;
+    uint32_t numIds = 0;
+
+    // Frames from head to tail are waiting for the writer, the recording thread sleeps on frameDone while all are full,
+    // the writer sleeps on frameReady while none are. A mutex is used to guard these
+    TrajectoryPendingFrame pending[TRAJECTORY_QUEUE];
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable frameReady;
+    std::condition_variable frameDone;
+    bool stopping = false;
+
+    // Writer thread only, positions by id. Dead ids keep the position they died at
+    std::vector<int32_t> x;
+    std::vector<int32_t> y;
+    std::vector<int32_t> lastX; //As of the frame before
+    std::vector<int32_t> lastY;
+    std::vector<uint64_t> alive;
+    std::vector<uint8_t> payload;
+    std::vector<TrajectoryKeyframe> keyframes;
+    uint32_t numFrames = 0;
+    uint64_t offset = 0;
+    bool failed = false;
+};
+
+//Creates path and starts the writer thread, the world gives the moving ids and their radii. Returns false, after saying
+//why, if path can't be created
+bool StartTrajectoryRecorder(TrajectoryRecorder& recorder, const char* path, const World& world);
+
+//Queues the positions and removals of a frame, call once for every frame in order
+void RecordTrajectoryFrame(TrajectoryRecorder& recorder, const FrameState& frame);
+
+//Writes every queued frame and the keyframe index, then closes the file. Returns false, after saying why, if any write failed
+bool StopTrajectoryRecorder(TrajectoryRecorder& recorder);
+
+//---------------------------------------------------------------------------------------------------------------------
+// Reader
+//---------------------------------------------------------------------------------------------------------------------
+
+// Reads frames back as FrameStates, so a visualiser can be fed without running the simulation. The change mask marks the
+// circles whose quantised position changed
+
+struct TrajectoryReader
+{
+    MappedFile mapped;
+    TrajectoryHeader header;
+    std::vector<float> radii;
+    std::vector<TrajectoryKeyframe> keyframes;
+    uint32_t numFrames = 0;
+    uint64_t framesEnd = 0; //Offset just past the last whole frame
+
+    uint64_t offset = 0; //Of the next frame
+    uint32_t frame = 0;  //Index of the next frame
+    bool seeked = false; //The next frame marks every circle changed, as what was drawn is from elsewhere in the file
+
+    std::vector<int32_t> x;
+    std::vector<int32_t> y;
+    std::vector<uint64_t> alive;
+    std::vector<uint8_t> moved;
+};
+
+//Maps path and finds its keyframes. Returns false, after saying why, if it is not a trajectory
+bool OpenTrajectory(TrajectoryReader& reader, const char* path);
+
+//Decodes the next frame into frame, returns false at the end of the trajectory or, after saying so, if it is damaged
+bool ReadTrajectoryFrame(TrajectoryReader& reader, FrameState& frame);
+
+//Makes frame the next one read, decoding forward from the keyframe before it. That frame marks every circle changed, but
+//its removedMoving is only what died that frame, so whatever it is drawn with should match itself to the frame's movingIds.
+//Returns false if there is no such frame
+bool SeekTrajectory(TrajectoryReader& reader, uint32_t frame);
+
+void CloseTrajectory(TrajectoryReader& reader);